@@ -0,0 +1,59 @@
+/* see license for copyright and license */
+
+/**
+ * microbenchmark of the layouts (see layout)
+ *
+ * each layout is worked out for every window count from 1 to MAXWINDOWS
+ * on a 1920x1062 area, each count enough times to be timed, and the
+ * time it takes is written on stdout, tab separated: the layout, the
+ * window count and the nanoseconds it takes, for a spread of counts,
+ * then with "all" for the count, the nanoseconds all the counts take.
+ *
+ *   $ make benchlayouts
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+#include <time.h>
+
+#define MAXWINDOWS 10000
+#define MINTIME    100000L /* nanoseconds to repeat a layout for at least */
+
+static const int shown[] = { 1, 2, 3, 4, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, MAXWINDOWS };
+static const char *modenames[MODES] = { [TILE] = "tile", [MONOCLE] = "monocle", [BSTACK] = "bstack", [GRID] = "grid" };
+
+/**
+ * the monotonic time in nanoseconds
+ */
+long long nsec(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int main(void) {
+    static XRectangle r[MAXWINDOWS];
+    const XRectangle area = { 0, 18, 1920, 1062 };
+    volatile unsigned int sink = 0; /* keeps the layouts from being optimized away */
+
+    printf("layout\twindows\tns\n");
+    for (int m = 0; m < MODES; m++) if (layout[m]) {
+        long long all = 0;
+        for (int n = 1, k = 0; n <= MAXWINDOWS; n++) {
+            int masz = (m == BSTACK ? area.height:area.width) * MASTER_SIZE;
+            long long start = nsec(), t = 0;
+            long reps = 0;
+            do {
+                layout[m](m, n, masz, 0, area, BORDER_WIDTH, r);
+                sink += r[n - 1].width;
+                reps++;
+            } while ((t = nsec() - start) < MINTIME);
+            all += t / reps;
+            if (n == shown[k]) printf("%s\t%d\t%lld\n", modenames[m], shown[k++], t / reps);
+        }
+        printf("%s\tall\t%lld\n", modenames[m], all);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# end to end benchmark of monsterwm, see swarm.c
+#
+# starts a BENCH build of monsterwm on Xvfb, with the key bindings the
+# swarm presses set in its config file, drives it with the swarm and
+# writes on stdout, tab separated, for each operation as seen by the
+# clients and for each batch as reported by the wm: where it was measured,
+# the operation, the number of samples, the 50th and 99th percentile of
+# the latency in microseconds and the mean number of requests the wm made
+#
+#   usage: run.sh [windows] [rounds]
+
+windows=${1:-2000}
+rounds=${2:-500}
+dir=$(dirname "$0")
+
+command -v Xvfb >/dev/null || { echo "run.sh: Xvfb is needed" >&2; exit 1; }
+tmp=$(mktemp -d) || exit 1
+trap 'kill $wm $xvfb 2>/dev/null; rm -rf "$tmp"' EXIT
+trap 'exit 1' INT TERM
+
+cat >"$tmp/.monsterwmrc" <<EOF
+bind Mod1 F1 change_desktop 0
+bind Mod1 F2 change_desktop 1
+bind Mod1 j next_win
+bind Mod1 Return swap_master
+EOF
+
+Xvfb -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp 3>"$tmp/display" 2>/dev/null &
+xvfb=$!
+for i in $(seq 100); do [ -s "$tmp/display" ] && break; sleep 0.1; done
+[ -s "$tmp/display" ] || { echo "run.sh: Xvfb did not start" >&2; exit 1; }
+export DISPLAY=":$(cat "$tmp/display")"
+
+HOME=$tmp XDG_RUNTIME_DIR=$tmp "$dir/monsterwm" >/dev/null 2>"$tmp/wm.log" &
+wm=$!
+"$dir/swarm" "$windows" "$rounds" >"$tmp/samples" || { cat "$tmp/wm.log" >&2; exit 1; }
+kill $wm
+wait $wm 2>/dev/null
+wm=
+
+tab=$(printf '\t')
+sed -n "s/^bench$tab/wm$tab/p" "$tmp/wm.log" >>"$tmp/samples"
+sort -t "$tab" -k1,1 -k2,2 -k3,3n "$tmp/samples" | awk -F '\t' -v OFS='\t' '
+    function rank(p) { i = int(p * n); if (i < p * n) i++; return v[i > 0 ? i:1] }
+    function flush() { if (n) print src, op, n, rank(0.50), rank(0.99), req == "" ? "-":sprintf("%.1f", req / n) }
+    BEGIN { print "source", "op", "samples", "p50_us", "p99_us", "requests" }
+    $1 != src || $2 != op { flush(); src = $1; op = $2; n = 0; req = "" }
+    { v[++n] = $3; if ($4 != "-") req += $4 }
+    END { flush() }'
@@ -0,0 +1,255 @@
+/* see license for copyright and license */
+
+/**
+ * a swarm of synthetic clients driving monsterwm, see run.sh
+ *
+ * the windows are mapped one after the other, and the keys of the bindings
+ * are pressed through the XTest extension, each operation waiting for the
+ * change it makes to be seen before the next starts:
+ *
+ *   maprequest     - a window is mapped, until it is mapped and configured
+ *   change_desktop - Mod1+F1 or Mod1+F2, until _NET_CURRENT_DESKTOP changes
+ *   next_win       - Mod1+j, until _NET_ACTIVE_WINDOW changes
+ *   swap_master    - Mod1+Return, until a window is configured
+ *   fullscreen     - a _NET_WM_STATE message toggling the fullscreen state
+ *                    of a window, until the window is configured
+ *
+ * some windows also set and clear their urgency hint now and then, for
+ * the wm to handle, without waiting. the latency of each operation is
+ * written on stdout, one tab separated line each: "client", the name of
+ * the operation, the microseconds it took and "-" for the requests, as
+ * those the wm made are reported by the wm itself in BENCH builds.
+ *
+ *   usage: swarm windows rounds
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <poll.h>
+#include <time.h>
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+#include <X11/keysym.h>
+
+#define LENGTH(x) (sizeof(x)/sizeof(*x))
+#define TIMEOUT   10000 /* milliseconds to wait for the wm before giving up */
+
+enum { NET_CURRENT_DESKTOP, NET_ACTIVE, NET_WM_STATE, NET_FULLSCREEN, ATOMS };
+static const char *atomnames[ATOMS] = {
+    [NET_CURRENT_DESKTOP] = "_NET_CURRENT_DESKTOP", [NET_ACTIVE]     = "_NET_ACTIVE_WINDOW",
+    [NET_WM_STATE]        = "_NET_WM_STATE",        [NET_FULLSCREEN] = "_NET_WM_STATE_FULLSCREEN",
+};
+
+static xcb_connection_t *con;
+static xcb_screen_t *screen;
+static xcb_atom_t atoms[ATOMS];
+static xcb_window_t *wins;
+static int nwins;
+static xcb_keycode_t alt, f1, f2, j, ret;
+
+/**
+ * the monotonic time in microseconds
+ */
+long now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000L + t.tv_nsec / 1000;
+}
+
+/**
+ * drop the events that arrived so far, once the server has seen all requests
+ */
+void drain(void) {
+    xcb_generic_event_t *e = NULL;
+    free(xcb_get_input_focus_reply(con, xcb_get_input_focus(con), NULL));
+    while ((e = xcb_poll_for_event(con))) free(e);
+}
+
+/**
+ * the next event, waiting for it up to TIMEOUT, for the given reason
+ */
+xcb_generic_event_t* nextevent(const char *what) {
+    xcb_generic_event_t *e = NULL;
+    for (long end = now() + TIMEOUT * 1000L; !(e = xcb_poll_for_event(con));) {
+        if (xcb_connection_has_error(con)) errx(EXIT_FAILURE, "lost the connection to the server");
+        if (now() > end) errx(EXIT_FAILURE, "timed out waiting for %s", what);
+        poll(&(struct pollfd){ xcb_get_file_descriptor(con), POLLIN, 0 }, 1, 100);
+    }
+    return e;
+}
+
+/**
+ * whether the event is of the given type and about the given window, any
+ * of the swarm's windows if none, and the given atom for property changes
+ */
+int seen(const xcb_generic_event_t *e, int type, xcb_window_t w, xcb_atom_t a) {
+    int t = e->response_type & ~0x80;
+    if (t != type) return 0;
+    if (t == XCB_PROPERTY_NOTIFY)
+        return ((xcb_property_notify_event_t *)e)->window == w && ((xcb_property_notify_event_t *)e)->atom == a;
+    if (t == XCB_CONFIGURE_NOTIFY)
+        return ((xcb_configure_notify_event_t *)e)->window == (w ? w:((xcb_configure_notify_event_t *)e)->event)
+            && ((xcb_configure_notify_event_t *)e)->window != screen->root;
+    return t == XCB_MAP_NOTIFY && ((xcb_map_notify_event_t *)e)->window == w;
+}
+
+/**
+ * wait for an event, see seen
+ */
+void waitfor(int type, xcb_window_t w, xcb_atom_t a, const char *what) {
+    for (int found = 0; !found;) {
+        xcb_generic_event_t *e = nextevent(what);
+        found = seen(e, type, w, a);
+        free(e);
+    }
+}
+
+/**
+ * the keycode of the given keysym, from the first column of the keyboard mapping
+ */
+xcb_keycode_t keycode(xcb_keysym_t sym) {
+    const xcb_setup_t *s = xcb_get_setup(con);
+    xcb_get_keyboard_mapping_reply_t *m = xcb_get_keyboard_mapping_reply(con,
+            xcb_get_keyboard_mapping(con, s->min_keycode, s->max_keycode - s->min_keycode + 1), NULL);
+    if (!m) errx(EXIT_FAILURE, "cannot get the keyboard mapping");
+    xcb_keysym_t *syms = xcb_get_keyboard_mapping_keysyms(m);
+    xcb_keycode_t k = 0;
+    for (int i = 0; !k && i < xcb_get_keyboard_mapping_keysyms_length(m); i += m->keysyms_per_keycode)
+        if (syms[i] == sym) k = s->min_keycode + i / m->keysyms_per_keycode;
+    free(m);
+    if (!k) errx(EXIT_FAILURE, "no keycode for keysym 0x%x", sym);
+    return k;
+}
+
+/**
+ * press and release the given key with Mod1 held
+ */
+void press(xcb_keycode_t k) {
+    xcb_test_fake_input(con, XCB_KEY_PRESS, alt, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    xcb_test_fake_input(con, XCB_KEY_PRESS, k, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    xcb_test_fake_input(con, XCB_KEY_RELEASE, k, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    xcb_test_fake_input(con, XCB_KEY_RELEASE, alt, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    xcb_flush(con);
+}
+
+/**
+ * write the latency of an operation that started at the given time
+ */
+void report(const char *op, long start) {
+    printf("client\t%s\t%ld\t-\n", op, now() - start);
+}
+
+/**
+ * create and map a window, 1x1 in the corner so that tiling it configures it
+ */
+void mapwindow(void) {
+    xcb_window_t w = wins[nwins++] = xcb_generate_id(con);
+    xcb_create_window(con, XCB_COPY_FROM_PARENT, w, screen->root, 0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      screen->root_visual, XCB_CW_EVENT_MASK, (uint32_t[]){ XCB_EVENT_MASK_STRUCTURE_NOTIFY });
+    xcb_change_property(con, XCB_PROP_MODE_REPLACE, w, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 8, 12, "swarm\0Swarm");
+    drain();
+    long start = now();
+    xcb_map_window(con, w);
+    xcb_flush(con);
+    for (int mapped = 0, configured = 0; !mapped || !configured;) {
+        xcb_generic_event_t *e = nextevent("a window to be mapped and configured");
+        mapped |= seen(e, XCB_MAP_NOTIFY, w, XCB_NONE);
+        configured |= seen(e, XCB_CONFIGURE_NOTIFY, w, XCB_NONE);
+        free(e);
+    }
+    report("maprequest", start);
+}
+
+/**
+ * set or clear the urgency hint of a window
+ */
+void urgent(xcb_window_t w, int set) {
+    uint32_t hints[9] = { set ? 1 << 8:0 };
+    xcb_change_property(con, XCB_PROP_MODE_REPLACE, w, XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 32, LENGTH(hints), hints);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 || atoi(argv[1]) < 2 || atoi(argv[2]) < 1) errx(EXIT_FAILURE, "usage: swarm windows rounds");
+    int n = atoi(argv[1]), rounds = atoi(argv[2]), desk = 0;
+
+    if (xcb_connection_has_error((con = xcb_connect(NULL, NULL)))) errx(EXIT_FAILURE, "cannot open display");
+    screen = xcb_setup_roots_iterator(xcb_get_setup(con)).data;
+    if (!(wins = calloc(n + n / 4, sizeof(xcb_window_t)))) err(EXIT_FAILURE, "cannot allocate windows");
+
+    xcb_intern_atom_cookie_t cookies[ATOMS];
+    for (int i = 0; i < ATOMS; i++) cookies[i] = xcb_intern_atom(con, 0, strlen(atomnames[i]), atomnames[i]);
+    for (int i = 0; i < ATOMS; i++) {
+        xcb_intern_atom_reply_t *r = xcb_intern_atom_reply(con, cookies[i], NULL);
+        if (!r) errx(EXIT_FAILURE, "cannot intern %s", atomnames[i]);
+        atoms[i] = r->atom;
+        free(r);
+    }
+    alt = keycode(XK_Alt_L); f1 = keycode(XK_F1); f2 = keycode(XK_F2); j = keycode(XK_j); ret = keycode(XK_Return);
+
+    /* the wm is ready once it published the current desktop */
+    for (long end = now() + TIMEOUT * 1000L;;) {
+        xcb_get_property_reply_t *r = xcb_get_property_reply(con, xcb_get_property(con, 0, screen->root,
+                                      atoms[NET_CURRENT_DESKTOP], XCB_ATOM_CARDINAL, 0, 1), NULL);
+        int ready = r && xcb_get_property_value_length(r);
+        free(r);
+        if (ready) break;
+        if (now() > end) errx(EXIT_FAILURE, "timed out waiting for the wm");
+        nanosleep(&(struct timespec){ 0, 50000000L }, NULL);
+    }
+    xcb_change_window_attributes(con, screen->root, XCB_CW_EVENT_MASK, (uint32_t[]){ XCB_EVENT_MASK_PROPERTY_CHANGE });
+
+    /* most windows on the first desktop, a quarter as many on the second */
+    for (int i = 0; i < n; i++) mapwindow();
+    for (int d = 1; d >= 0; d--) {
+        drain();
+        long start = now();
+        press(d ? f2:f1);
+        waitfor(XCB_PROPERTY_NOTIFY, screen->root, atoms[NET_CURRENT_DESKTOP], "the desktop to change");
+        report("change_desktop", start);
+        for (int i = 0; d && i < n / 4; i++) mapwindow();
+    }
+
+    for (int r = 0; r < rounds + rounds % 2; r++) {
+        drain();
+        long start = now();
+        press((desk = !desk) ? f2:f1);
+        waitfor(XCB_PROPERTY_NOTIFY, screen->root, atoms[NET_CURRENT_DESKTOP], "the desktop to change");
+        report("change_desktop", start);
+    }
+    for (int r = 0; r < rounds; r++) {
+        drain();
+        long start = now();
+        press(j);
+        waitfor(XCB_PROPERTY_NOTIFY, screen->root, atoms[NET_ACTIVE], "the focus to change");
+        report("next_win", start);
+        urgent(wins[r % n], r % 2);
+    }
+    for (int r = 0; r < rounds; r++) {
+        drain();
+        long start = now();
+        press(ret);
+        waitfor(XCB_CONFIGURE_NOTIFY, XCB_NONE, XCB_NONE, "the master to change");
+        report("swap_master", start);
+    }
+    for (int r = 0; r < rounds; r++) {
+        xcb_window_t w = wins[r / 2 % n];
+        xcb_client_message_event_t m = {
+            .response_type = XCB_CLIENT_MESSAGE, .format = 32, .window = w, .type = atoms[NET_WM_STATE],
+            .data.data32 = { 2, atoms[NET_FULLSCREEN], 0, 1, 0 },
+        };
+        drain();
+        long start = now();
+        xcb_send_event(con, 0, screen->root, XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT|XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, (const char *)&m);
+        xcb_flush(con);
+        waitfor(XCB_CONFIGURE_NOTIFY, w, XCB_NONE, "a window to go fullscreen");
+        report("fullscreen", start);
+    }
+
+    xcb_disconnect(con);
+    free(wins);
+    return EXIT_SUCCESS;
+}
@@ -14,6 +14,7 @@
 #define SHOW_PANEL      True      /* show panel by default on exec */
 #define TOP_PANEL       True      /* False means panel is on bottom */
 #define PANEL_HEIGHT    18        /* 0 for no space for panel, thus no panel */
+#define EXTENDED_INFO   False     /* also output the class and title of the current window */
 #define DEFAULT_MODE    TILE      /* initial layout/mode: TILE MONOCLE BSTACK GRID FLOAT */
 #define ATTACH_ASIDE    True      /* False means new window is master */
 #define FOLLOW_WINDOW   False     /* follow the window when moved to a different desktop */
@@ -24,17 +25,23 @@
 #define FOCUS           "#ff950e" /* focused window border color    */
 #define UNFOCUS         "#444444" /* unfocused window border color  */
 #define MINWSZ          50        /* minimum window size in pixels  */
+#define REFRESH_RATE    60        /* moves or resizes per second when using the mouse, the screen's refresh rate */
 #define DEFAULT_DESKTOP 0         /* the desktop to focus initially */
-#define DESKTOPS        4         /* number of desktops - edit DESKTOPCHANGE keys to suit */
+#define DESKTOPS        4         /* initial number of desktops - edit DESKTOPCHANGE keys to suit */
+#define SOCKET_PATH     "%s/monsterwm%s"   /* control socket, in $XDG_RUNTIME_DIR or else /tmp, then the display */
+#define CONFIG_FILE     ".monsterwmrc"     /* in $HOME, overrides the colors, border width, master size, keys and rules */
 
 /**
  * open applications to specified desktop with specified mode.
  * if desktop is negative, then current is assumed
+ * class and instance must match exactly, title and role are extended
+ * regular expressions, type is a _NET_WM_WINDOW_TYPE atom name.
+ * NULL matches any window, the first rule that matches is used
  */
 static const AppRule rules[] = { \
-    /*  class     desktop  follow  float */
-    { "MPlayer",     3,    True,   False },
-    { "Gimp",        0,    False,  True  },
+    /*  class     instance  title  role  type  desktop  follow  float */
+    { "MPlayer",  NULL,     NULL,  NULL, NULL,    3,    True,   False },
+    { "Gimp",     NULL,     NULL,  NULL, NULL,    0,    False,  True  },
 };
 
 /* helper for spawning shell commands */
@@ -90,6 +97,8 @@ static Key keys[] = {
     {  MOD4|SHIFT,       XK_k,          moveresize,        {.v = (int []){   0,   0,   0, -25 }}}, /* height shrink */
     {  MOD4|SHIFT,       XK_l,          moveresize,        {.v = (int []){   0,   0,  25,   0 }}}, /* width grow    */
     {  MOD4|SHIFT,       XK_h,          moveresize,        {.v = (int []){   0,   0, -25,   0 }}}, /* width shrink  */
+    {  MOD4,             XK_F1,         change_monitor,    {.i = 0}},
+    {  MOD4,             XK_F2,         change_monitor,    {.i = 1}},
        DESKTOPCHANGE(    XK_F1,                             0)
        DESKTOPCHANGE(    XK_F2,                             1)
        DESKTOPCHANGE(    XK_F3,                             2)
@@ -3,26 +3,58 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <regex.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#if defined BENCH || defined METRICS
+#include <sys/time.h>
+#endif
 #include <X11/Xutil.h>
 #include <X11/XKBlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xatom.h>
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#endif
+#ifdef RANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+#ifdef INOTIFY
+#include <sys/inotify.h>
+#endif
 
 #define LENGTH(x)       (sizeof(x)/sizeof(*x))
+#define MIN(a, b)       ((a) < (b) ? (a):(b))
+#define MAX(a, b)       ((a) > (b) ? (a):(b))
+#ifndef PIPE_BUF
+#define PIPE_BUF        512 /* the least any system guarantees */
+#endif
 #define CLEANMASK(mask) (mask & ~(numlockmask | LockMask))
 #define BUTTONMASK      ButtonPressMask|ButtonReleaseMask
 #define ISFFT(c)        (c->isfull || c->isfloat || c->istrans)
-#define ROOTMASK        SubstructureRedirectMask|ButtonPressMask|SubstructureNotifyMask|PropertyChangeMask
+#define RECT(x, y, w, h) (XRectangle){ (x), (y), MAX((w), 1), MAX((h), 1) }
+#define ROOTMASK        SubstructureRedirectMask|ButtonPressMask|SubstructureNotifyMask|PropertyChangeMask|StructureNotifyMask
+#define CONTMASK        SubstructureRedirectMask|SubstructureNotifyMask
+#define WINBITS         8
+#define WINSLOT(w)      ((unsigned int)((w) * 2654435761UL) >> (32 - WINBITS))
 
 enum { RESIZE, MOVE };
 enum { TILE, MONOCLE, BSTACK, GRID, FLOAT, MODES };
-enum { WM_PROTOCOLS, WM_DELETE_WINDOW, WM_COUNT };
-enum { NET_SUPPORTED, NET_FULLSCREEN, NET_WM_STATE, NET_ACTIVE, NET_COUNT };
+enum { WM_PROTOCOLS, WM_DELETE_WINDOW, WM_UTF8_STRING, WM_WINDOW_ROLE, WM_COUNT };
+enum { NET_SUPPORTED, NET_FULLSCREEN, NET_WM_STATE, NET_ACTIVE, NET_WM_DESKTOP, NET_WM_NAME,
+       NET_NUMBER_DESKTOPS, NET_CURRENT_DESKTOP, NET_DESKTOP_NAMES, NET_CLIENT_LIST,
+       NET_CLIENT_STACKING, NET_WM_WINDOW_TYPE, NET_COUNT };
 
 /**
  * argument structure to be passed to function by config.h
@@ -67,18 +99,39 @@ typedef struct {
  * define behavior of certain applications
  * configured in config.h
  *
- * class   - the class or name of the instance
- * desktop - what desktop it should be spawned at
- * follow  - whether to change desktop focus to the specified desktop
+ * class    - the class of the window, matched exactly
+ * instance - the instance name of the window, matched exactly
+ * title    - an extended regular expression the title must match
+ * role     - an extended regular expression the WM_WINDOW_ROLE must match
+ * type     - the name of the _NET_WM_WINDOW_TYPE atom the window must have first
+ * desktop  - what desktop it should be spawned at
+ * follow   - whether to change desktop focus to the specified desktop
+ *
+ * the properties left NULL match any window (see compilerules)
  */
 typedef struct {
-    const char *class;
+    const char *class, *instance, *title, *role, *type;
     const int desktop;
     const Bool follow, floating;
 } AppRule;
 
+/**
+ * a command given through the control socket (see runcommand)
+ * name - the name of the command
+ * func - the function to be triggered by the command
+ * args - the number of integer arguments the function takes,
+ *        one is passed as the integer, more as an array
+ * min, max - the range each of the arguments must be in (see cmdarg)
+ */
+typedef struct {
+    const char *name;
+    void (*func)(const Arg *);
+    const int args, min, max;
+} Command;
+
 /* exposed function prototypes sorted alphabetically */
 static void change_desktop(const Arg *arg);
+static void change_monitor(const Arg *arg);
 static void client_to_desktop(const Arg *arg);
 static void focusurgent();
 static void killclient();
@@ -94,6 +147,7 @@ static void resize_master(const Arg *arg);
 static void resize_stack(const Arg *arg);
 static void rotate(const Arg *arg);
 static void rotate_filled(const Arg *arg);
+static void set_desktops(const Arg *arg);
 static void spawn(const Arg *arg);
 static void swap_master();
 static void switch_mode(const Arg *arg);
@@ -105,20 +159,40 @@ static void togglepanel();
  * a client is a wrapper to a window that additionally
  * holds some properties for that window
  *
- * next    - the client after this one, or NULL if the current is the last client
+ * pos     - the position of the client in its desktop's client list
+ * hnext   - the next client in the same window index bucket
+ * desk    - the index of the desktop the client belongs to
+ * x, y, w, h, bw - the geometry and border width of the window, as last
+ *           requested by the wm or reported by the server (see resize)
+ * serial  - the serial of the last request that configured the window
  * isurgn  - set when the window received an urgent hint
  * isfull  - set when the window is fullscreen
  * isfloat - set when the window is floating
  * istrans - set when the window is transient
+ * candelete - set when the window accepts WM_DELETE_WINDOW messages
  * win     - the window this client is representing
+ * class   - the class name of the window
+ * title   - the title of the window, kept only with EXTENDED_INFO
+ * stackpos - the position of the window in the stacking order last applied
+ *            on its desktop, counting from one at the top, or zero when its
+ *            position relative to the other windows is not known (see refocus)
+ * hasbtns - set when the buttons of the bindings are grabbed on the window
+ * hasfbtn - set when the focus button is grabbed on the window
+ * numlock - the numlock modifier the buttons were grabbed with
+ * unmaps  - the number of unmap notifications the wm caused itself
+ *           and that are still to come for the window (see unmapnotify)
  *
  * istrans is separate from isfloat as floating windows can be reset to
  * their tiling positions, while the transients will always be floating
  */
 typedef struct Client {
-    struct Client *next;
-    Bool isurgn, isfull, isfloat, istrans;
+    struct Client *hnext;
+    Bool isurgn, isfull, isfloat, istrans, candelete, hasbtns, hasfbtn;
+    int pos, desk, x, y, w, h, bw, stackpos, unmaps;
+    unsigned int numlock;
+    unsigned long serial;
     Window win;
+    char class[64], title[256];
 } Client;
 
 /**
@@ -127,70 +201,306 @@ typedef struct Client {
  * masz - the size of the master area
  * sasz - additional size of the first stack window area
  * mode - the desktop's tiling layout mode
- * head - the start of the client list
+ * list - the clients of the desktop in order, the first being the master
  * curr - the currently highlighted window
  * prev - the client that previously had focus
  * sbar - the visibility status of the panel/statusbar
+ * gen  - the layout generation, changes whenever the clients, the mode,
+ *        the master and stack sizes, the panel visibility or the
+ *        floating and fullscreen state of the clients change
+ * tgen - the layout generation the desktop was last tiled at
+ * fgen - the layout generation the borders and stacking order of
+ *        the clients were last worked out at, see refocus
+ * focused - the client last shown as focused, see refocus
+ * dirty - whether the focus needs to be applied once the
+ *         current batch of events is handled, see commit
+ * count  - the number of clients on the desktop, kept in the list
+ * size   - the number of clients the list has room for
+ * stack  - the windows of the clients from the bottom of the stack to the
+ *          top, as published in the stacking list, see updateewmh
+ * sorted - whether the stack is up to date, it is not once clients are added
+ *          or removed, or restacked to where the wm does not know
+ * urgent - the number of clients on the desktop with an urgent hint
+ * cont   - the container window the windows of the clients are put in,
+ *          mapped only while a monitor shows the desktop
+ * cx, cy, cw, ch - the geometry of the container, the client
+ *          geometry is kept relative to the root all the same
  */
 typedef struct {
-    int mode, masz, sasz;
-    Client *head, *curr, *prev;
-    Bool sbar;
+    int mode, masz, sasz, count, size, urgent;
+    Client **list, *curr, *prev, *focused;
+    Window *stack;
+    Bool sbar, dirty, sorted;
+    unsigned int gen, tgen, fgen;
+    Window cont;
+    int cx, cy, cw, ch;
 } Desktop;
 
+/**
+ * a monitor is an output of the screen, showing one of the desktops
+ *
+ * x, y, w, h - the area of the monitor left for the windows,
+ *              the panel height excluded
+ * desk       - the index of the desktop the monitor shows
+ */
+typedef struct {
+    int x, y, w, h, desk;
+} Monitor;
+
+/**
+ * what a layout is worked out from, see arrange
+ *
+ * mode       - the layout mode, monocle for a single client
+ * n          - the number of windows tiled
+ * masz       - the size of the master area, its width in tile mode
+ *              and its height in bstack mode
+ * sasz       - the additional size of the first stack window area
+ * bw         - the border width of the windows
+ * x, y, w, h - the area the windows are tiled in, the panel excluded if shown
+ */
+typedef struct {
+    int mode, n, masz, sasz, bw, x, y, w, h;
+} Shape;
+
+/**
+ * what is needed to know about a window before managing it
+ *
+ * valid    - set when the window exists and its attributes were read
+ * override - set when the window is override redirect and not to be managed
+ * viewable - set when the window is mapped
+ * desk     - the desktop the window was last placed on, or -1 (see scan)
+ * x, y, w, h, bw - the geometry and border width of the window
+ * istrans  - set when the window is transient for another window
+ * isfull   - set when the window asks to be fullscreen
+ * candelete - set when the window accepts WM_DELETE_WINDOW messages
+ * class    - the class name of the window
+ * instance - the instance name of the window
+ * title    - the title of the window
+ * role     - the role of the window, only fetched if a rule needs it
+ * type     - the first of the window's types, only fetched if a rule needs it
+ */
+typedef struct {
+    Bool valid, override, viewable, istrans, isfull, candelete;
+    int desk, x, y, w, h, bw;
+    Atom type;
+    char class[64], instance[64], title[256], role[64];
+} Probe;
+
+/**
+ * the settings in effect, those of config.h overridden by the config file
+ * (see readconfig), replaced as a whole when the file changes (see loadconfig)
+ *
+ * buf         - the file read in memory, the strings below point in it
+ * len         - the length of the file
+ * args        - the arguments of the key bindings read from the file
+ * keys        - the key bindings, those of config.h with the file's over them
+ * rules       - the app rules, the file's first and then those of config.h
+ * rulefirst   - for each hash of a class, or instance for the rules without a
+ *               class, the first of the rules keyed on it (plus one)
+ * rulenext    - for each rule, the next with the same hash (plus one)
+ * ruleany     - the first of the rules without a class or instance (plus one)
+ * ruletitle   - the compiled title pattern of each rule that has one
+ * rulerole    - the compiled role pattern of each rule that has one
+ * ruletype    - the type atom of each rule that has one
+ * compiled    - the number of rules whose patterns are compiled
+ * fetchrole   - whether a rule needs the role of new windows, see probe
+ * fetchtype   - whether a rule needs the type of new windows, see probe
+ * fetchtitle  - whether a rule needs the title of new windows, see probe
+ * focus, unfocus - the focused and unfocused window border colors
+ * borderwidth - the window border width
+ * mastersize  - the part of the screen the master area takes
+ */
+typedef struct {
+    char *buf;
+    size_t len;
+    struct { const char *com[4]; int v[4]; } *args;
+    Key *keys;
+    AppRule *rules;
+    unsigned int nkeys, nrules, compiled;
+    unsigned short rulefirst[256], *rulenext, ruleany;
+    regex_t *ruletitle, *rulerole;
+    Atom *ruletype;
+    Bool fetchrole, fetchtype, fetchtitle;
+    const char *focus, *unfocus;
+    int borderwidth;
+    float mastersize;
+} Config;
+
 /* hidden function prototypes sorted alphabetically */
 static Client* addwindow(Window w, Desktop *d);
+static void arrange(Desktop *d);
+static void attach(Client *c, Desktop *d, int i);
+static Bool bound(const XEvent *e);
 static void buttonpress(XEvent *e);
+#ifdef DEBUG
+static void checkindex(void);
+#endif
 static void cleanup(void);
 static void clientmessage(XEvent *e);
+static Bool cmdarg(const Command *c, const char *s, int *v);
+static void coalesce(XEvent *q, int n);
+static void commit(void);
+static Bool compilerules(Config *c);
+static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
 static void deletewindow(Window w);
+static Monitor* deskmon(int i);
 static void desktopinfo(void);
 static void destroynotify(XEvent *e);
+static void detach(Client *c, Desktop *d);
 static void enternotify(XEvent *e);
+static void fitcontainer(Desktop *d, const Monitor *m);
+static void flushinfo(void);
+static void freeconfig(Config *c);
 static void focus(Client *c, Desktop *d);
 static void focusin(XEvent *e);
-static unsigned long getcolor(const char* color, const int screen);
+static unsigned long getcolor(const char* color, unsigned long pixel);
+static void gettitle(Window w, char *title, size_t len);
 static void grabbuttons(Client *c);
 static void grabkeys(void);
-static void grid(int x, int y, int w, int h, const Desktop *d);
+static void grid(int mode, int n, int masz, int sasz, XRectangle a, int bw, XRectangle *r);
 static void keypress(XEvent *e);
+static void loadconfig(void);
+static Client* manage(Window w, const Probe *p, Desktop *d, Bool floating);
 static void maprequest(XEvent *e);
-static void monocle(int x, int y, int w, int h, const Desktop *d);
+static void mappingnotify(XEvent *e);
+static const AppRule* matchrule(const Probe *p);
+static void monocle(int mode, int n, int masz, int sasz, XRectangle a, int bw, XRectangle *r);
+static Client* nextclient(Client *c, Desktop *d);
+static char* nexttoken(char **s);
 static Client* prevclient(Client *c, Desktop *d);
+static void probe(const Window *w, Probe *p, int n);
 static void propertynotify(XEvent *e);
+static void readcommands(int i);
+static Bool readconfig(Config *c, const char *path);
+static void refocus(Desktop *d);
 static void removeclient(Client *c, Desktop *d);
+static void reparent(Client *c, const Desktop *d, Bool mapped);
+static void resize(Client *c, int x, int y, int w, int h);
 static void run(void);
+static void runcommand(char *s, int i);
+static void scan(void);
+#ifdef RANDR
+static void screenchange(XEvent *e);
+#endif
+static void sendconfigure(Client *c);
+static void sendline(int i, const char *s);
+static void setborder(Client *c, int bw);
 static void setfullscreen(Client *c, Desktop *d, Bool fullscrn);
 static void setup(void);
+static void showdesktop(Monitor *m, int i);
 static void sigchld(int sig);
-static void stack(int x, int y, int w, int h, const Desktop *d);
+static int stackorder(const void *a, const void *b);
+static unsigned int strhash(const char *s);
+static void stack(int mode, int n, int masz, int sasz, XRectangle a, int bw, XRectangle *r);
+static void tagwindow(Window w);
 static void tile(Desktop *d);
 static void unmapnotify(XEvent *e);
+static void updateewmh(void);
+static void updategeometry(int w, int h);
 static Bool wintoclient(Window w, Client **c, Desktop **d);
+static Bool wmdelete(Window w);
 static int xerror(Display *dis, XErrorEvent *ee);
 static int xerrorstart(Display *dis, XErrorEvent *ee);
+#if defined ROUNDTRIPS || defined METRICS
+static int countroundtrip(Display *dis);
+#endif
+#ifdef BENCH
+static void benchend(void);
+static void benchstart(void);
+#endif
+#ifdef INOTIFY
+static void readwatch(void);
+static Bool watchconfig(void);
+#endif
+#ifdef METRICS
+static void metrics(int i);
+static void record(int t, long usec, unsigned long req, unsigned long rt);
+static void sigusr1(int sig);
+#endif
 
 /**
  * global variables
  *
  * running      - whether the wm is accepting and processing more events
- * wh           - screen height
- * ww           - screen width
+ * monitors     - the monitors of the screen, see updategeometry
+ * nmonitors    - the number of monitors
  * dis          - the display aka dpy
  * root         - the root window
  * wmatoms      - array holding atoms for ICCCM support
  * netatoms     - array holding atoms for EWMH support
  * desktops     - array of managed desktops
- * currdeskidx  - which desktop is currently active
+ * ndesktops    - the number of desktops, see set_desktops
+ * filled       - the indices of the desktops that have clients, in order
+ * nfilled      - the number of desktops that have clients
+ * currdeskidx  - which desktop is currently active, its monitor has the focus
+ * wintable     - index of all clients by window, see wintoclient
+ * tags         - the windows the most recent requests were made on, see xerror
+ * restacked    - the serials of the first request of the last restack of the
+ *                current desktop and of the first request that followed it
+ * layouts      - the layouts last worked out with their shape, shared by the
+ *                desktops, the oldest is replaced first, see arrange
+ * nlayouts     - the number of layouts worked out
+ * ewmh         - the client lists and current desktop published on the root
+ *                window, with what changed since, see updateewmh
+ * info         - the status line, see desktopinfo and flushinfo
+ * sock         - the control socket listening for connections
+ * sockaddr     - the address the control socket is bound to
+ * conns        - the connections to the control socket, see readcommands
+ * keycodes     - the keycode each key binding is grabbed with, see grabkeys
+ * keyfirst     - for each keycode, the first of its key bindings (plus one)
+ *                whose keysym is the first of the keycode, see grabkeys
+ * keynext      - for each key binding, the next with the same keycode (plus one)
+ * conf         - the settings in effect, see loadconfig
+ * confpath     - the path of the config file
+ * watch        - the inotify instance watching the config file, see readwatch
+ * watched      - the watch of the config file, or of its directory while
+ *                there is no such file, see watchconfig
+ * rrevbase     - the first event number of the RandR extension, see screenchange
+ * bench        - the batch of events being handled, see benchend
+ * stats        - the metrics of each event type's handler, and of commit last
+ * dumpstats    - whether the metrics are to be reported, see sigusr1
  */
 static Bool running = True;
-static int wh, ww, currdeskidx, prevdeskidx, retval;
+static int nmonitors, currdeskidx, prevdeskidx, retval, ndesktops, nfilled, *filled;
 static unsigned int numlockmask, win_unfocus, win_focus;
 static Display *dis;
 static Window root;
 static Atom wmatoms[WM_COUNT], netatoms[NET_COUNT];
-static Desktop desktops[DESKTOPS];
+static Desktop *desktops;
+static Monitor *monitors;
+static Client *wintable[1 << WINBITS];
+static struct { unsigned long serial; Window win; } tags[64];
+static unsigned int ntags;
+static unsigned long restacked[2];
+static struct { Shape s; int size; XRectangle *r; } layouts[8];
+static unsigned int nlayouts;
+static struct { Window *list, *stack; int count, size, desk; Bool removed, restacked; } ewmh = { .desk = -1 };
+static struct { char line[BUFSIZ], out[BUFSIZ]; size_t len, off; Bool queued, closed; } info;
+static int sock = -1;
+static struct sockaddr_un sockaddr = { .sun_family = AF_UNIX };
+static struct { int fd; Bool sub; size_t len; char buf[256]; } conns[16];
+static KeyCode *keycodes;
+static unsigned short keyfirst[256], *keynext;
+static Config conf;
+static char confpath[256];
+static int watch = -1;
+#ifdef INOTIFY
+static int watched = -1;
+#endif
+#if defined ROUNDTRIPS || defined METRICS
+static unsigned long roundtrips, lastreply;
+#endif
+#ifdef BENCH
+static struct { const char *op; Bool echo; struct timeval start; unsigned long req; } bench;
+#endif
+#ifdef METRICS
+static struct { unsigned long count, req, rt, usec[32]; } stats[LASTEvent + 1];
+static volatile sig_atomic_t dumpstats;
+#endif
+#ifdef RANDR
+static int rrevbase = -1;
+#endif
 
 /**
  * array of event handlers
@@ -204,43 +514,166 @@ static void (*events[LASTEvent])(XEvent *e) = {
     [ButtonPress]      = buttonpress,  [DestroyNotify]  = destroynotify,
     [UnmapNotify]      = unmapnotify,  [PropertyNotify] = propertynotify,
     [ConfigureRequest] = configurerequest,    [FocusIn] = focusin,
+    [ConfigureNotify]  = configurenotify,     [MappingNotify] = mappingnotify,
+};
+
+#if defined BENCH || defined METRICS
+/**
+ * the names the batches of events are reported with (see benchend),
+ * when no key binding or command names them, and the names of the
+ * handlers metrics are reported for
+ */
+static const char *evnames[LASTEvent] = {
+    [KeyPress]         = "keypress",         [EnterNotify]    = "enternotify",
+    [MapRequest]       = "maprequest",       [ClientMessage]  = "clientmessage",
+    [ButtonPress]      = "buttonpress",      [DestroyNotify]  = "destroynotify",
+    [UnmapNotify]      = "unmapnotify",      [PropertyNotify] = "propertynotify",
+    [ConfigureRequest] = "configurerequest", [FocusIn]        = "focusin",
+    [ConfigureNotify]  = "configurenotify",  [MappingNotify]  = "mappingnotify",
 };
+#endif
 
 /**
  * array of layout handlers
  *
- * x - the start position in the x axis to place clients
- * y - the start position in the y axis to place clients
- * w - available width  that windows have to expand
- * h - available height that windows have to expand
- * d - the desktop to tile its clients
+ * mode - the layout mode, for the handlers of more than one
+ * n    - the number of windows to tile, at least one
+ * masz - the size of the master area, see Shape
+ * sasz - additional size of the first stack window area
+ * a    - the area the windows have to expand in
+ * bw   - the border width of the windows
+ * r    - where the geometry of each of the n windows is written, in order
+ *
+ * the handlers only compute, from their arguments alone, and arrange
+ * applies what they write
  */
-static void (*layout[MODES])(int x, int y, int w, int h, const Desktop *d) = {
+static void (*layout[MODES])(int mode, int n, int masz, int sasz, XRectangle a, int bw, XRectangle *r) = {
     [TILE] = stack, [BSTACK] = stack, [GRID] = grid, [MONOCLE] = monocle,
 };
 
+/**
+ * array of commands accepted through the control socket
+ * each is named after the function it triggers
+ */
+static const Command commands[] = {
+    { "change_desktop",    change_desktop,    1, 0, 255 },
+    { "change_monitor",    change_monitor,    1, 0, 255 },
+    { "client_to_desktop", client_to_desktop, 1, 0, 255 },
+    { "focusurgent",       focusurgent,       0, 0, 0 },
+    { "killclient",        killclient,        0, 0, 0 },
+    { "last_desktop",      last_desktop,      0, 0, 0 },
+    { "move_down",         move_down,         0, 0, 0 },
+    { "move_up",           move_up,           0, 0, 0 },
+    { "moveresize",        moveresize,        4, -32768, 32767 },
+    { "next_win",          next_win,          0, 0, 0 },
+    { "prev_win",          prev_win,          0, 0, 0 },
+    { "quit",              quit,              1, 0, 255 },
+    { "resize_master",     resize_master,     1, -32768, 32767 },
+    { "resize_stack",      resize_stack,      1, -32768, 32767 },
+    { "rotate",            rotate,            1, -255, 255 },
+    { "rotate_filled",     rotate_filled,     1, -255, 255 },
+    { "set_desktops",      set_desktops,      1, 1, 256 },
+    { "swap_master",       swap_master,       0, 0, 0 },
+    { "switch_mode",       switch_mode,       1, 0, MODES - 1 },
+    { "togglepanel",       togglepanel,       0, 0, 0 },
+};
+
 /**
  * add the given window to the given desktop
  *
  * create a new client to hold the new window
  *
- * if there is no head at the given desktop
- * add the window as the head
- * otherwise if ATTACH_ASIDE is not set,
+ * if ATTACH_ASIDE is set,
  * add the window as the last client
  * otherwise add the window as head
+ *
+ * finally record the client in the window index
+ * and tell the window which desktop it is on
  */
 Client* addwindow(Window w, Desktop *d) {
-    Client *c = NULL, *t = prevclient(d->head, d);
+    Client *c = NULL;
     if (!(c = (Client *)calloc(1, sizeof(Client)))) err(EXIT_FAILURE, "cannot allocate client");
-    if (!d->head) d->head = c;
-    else if (!ATTACH_ASIDE) { c->next = d->head; d->head = c; }
-    else if (t) t->next = c; else d->head->next = c;
+    attach(c, d, ATTACH_ASIDE ? d->count:0);
+
+    c->hnext = wintable[WINSLOT(w)];
+    wintable[WINSLOT(w)] = c;
+    tagwindow(w);
+    XChangeProperty(dis, w, netatoms[NET_WM_DESKTOP], XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)&(long){c->desk}, 1);
 
     XSelectInput(dis, (c->win = w), PropertyChangeMask|FocusChangeMask|(FOLLOW_MOUSE?EnterWindowMask:0));
     return c;
 }
 
+/**
+ * tile clients of the given desktop with the desktop's mode/layout
+ * call the tiling handler fucntion taking account the panel height
+ * within the monitor showing the desktop, fullscreen windows cover it
+ *
+ * the handler works out the geometry of the non-floating, non-fullscreen
+ * windows, which is then applied to them in order. the same shapes come
+ * up again and again, when toggling floating or switching desktops, so
+ * the last layouts are kept and a layout of the same shape is reused
+ */
+void arrange(Desktop *d) {
+    const Monitor *m = deskmon(d - desktops);
+    for (int i = 0; i < d->count; i++)
+        if (d->list[i]->isfull) resize(d->list[i], m->x, m->y, m->w, m->h + PANEL_HEIGHT);
+    if (!d->count || d->mode == FLOAT) return; /* nothing to arange */
+
+    Client *t[d->count];
+    int n = 0;
+    for (int i = 0; i < d->count; i++) if (!ISFFT(d->list[i])) t[n++] = d->list[i];
+    if (!n) return;
+
+    int mode = d->count > 1 ? d->mode:MONOCLE, h = m->h + (d->sbar ? 0:PANEL_HEIGHT);
+    Shape s = { mode, n, (mode == BSTACK ? h:m->w) * conf.mastersize + d->masz, d->sasz, conf.borderwidth,
+                m->x, m->y + (TOP_PANEL && d->sbar ? PANEL_HEIGHT:0), m->w, h };
+    unsigned int k = 0;
+    while (k < LENGTH(layouts) && (!layouts[k].r || memcmp(&layouts[k].s, &s, sizeof s))) k++;
+    if (k == LENGTH(layouts)) {
+        k = nlayouts++ % LENGTH(layouts);
+        if (layouts[k].size < n && !(layouts[k].r = realloc(layouts[k].r, (layouts[k].size = n) * sizeof(XRectangle))))
+            err(EXIT_FAILURE, "cannot allocate layout");
+        layout[s.mode](s.mode, n, s.masz, s.sasz, (XRectangle){ s.x, s.y, s.w, s.h }, s.bw, layouts[k].r);
+        layouts[k].s = s;
+    }
+    const XRectangle *r = layouts[k].r;
+    for (int i = 0; i < n; i++) resize(t[i], r[i].x, r[i].y, r[i].width, r[i].height);
+}
+
+/**
+ * insert the client at the given position in the desktop's client list
+ * the clients after it are moved one position down, and the list grows
+ * when there is no room left; the first client marks the desktop filled
+ */
+void attach(Client *c, Desktop *d, int i) {
+    if (d->count == d->size && (!(d->list = realloc(d->list, (d->size = d->size ? 2*d->size:8) * sizeof(Client *)))
+        || !(d->stack = realloc(d->stack, d->size * sizeof(Window))))) err(EXIT_FAILURE, "cannot allocate client list");
+    d->sorted = False;
+    if (!d->count) {
+        int k = nfilled++;
+        for (; k > 0 && filled[k-1] > d - desktops; k--) filled[k] = filled[k-1];
+        filled[k] = d - desktops;
+    }
+    memmove(d->list + i + 1, d->list + i, (d->count++ - i) * sizeof(Client *));
+    for (d->list[i] = c, c->desk = d - desktops; i < d->count; i++) d->list[i]->pos = i;
+}
+
+/**
+ * whether the event is the press of a button binding (see buttons)
+ *
+ * the function of the binding may grab the pointer and read the events
+ * that follow by itself (see mousemotion), so no event is to be taken
+ * from the queue after it before it is handled (see run)
+ */
+Bool bound(const XEvent *e) {
+    if (e->type == ButtonPress) for (unsigned int i = 0; i < LENGTH(buttons); i++)
+        if (CLEANMASK(buttons[i].mask) == CLEANMASK(e->xbutton.state) &&
+            buttons[i].func && buttons[i].button == e->xbutton.button) return True;
+    return False;
+}
+
 /**
  * on the press of a key binding (see grabkeys)
  * call the appropriate handler
@@ -249,6 +682,7 @@ void buttonpress(XEvent *e) {
     Desktop *d = NULL; Client *c = NULL;
     Bool w = wintoclient(e->xbutton.window, &c, &d);
 
+    if (w && c->desk != currdeskidx) change_desktop(&(Arg){.i = c->desk});
     if (w && CLICK_TO_FOCUS && c != d->curr && e->xbutton.button == FOCUS_BUTTON) focus(c, d);
 
     for (unsigned int i = 0; i < LENGTH(buttons); i++)
@@ -262,62 +696,101 @@ void buttonpress(XEvent *e) {
 /**
  * focus another desktop
  *
- * to avoid flickering (esp. monocle mode):
- * first map the new windows
- * first the current window and then all other
- * then unmap the old windows
- * first all others then the current
+ * if the desktop is shown on another monitor that monitor
+ * gets the focus, otherwise the desktop is shown in place
+ * of the current one, see showdesktop
  */
 void change_desktop(const Arg *arg) {
-    if (arg->i == currdeskidx || arg->i < 0 || arg->i >= DESKTOPS) return;
-    Desktop *d = &desktops[(prevdeskidx = currdeskidx)], *n = &desktops[(currdeskidx = arg->i)];
-    if (n->curr) XMapWindow(dis, n->curr->win);
-    for (Client *c = n->head; c; c = c->next) XMapWindow(dis, c->win);
-    XChangeWindowAttributes(dis, root, CWEventMask, &(XSetWindowAttributes){.do_not_propagate_mask = SubstructureNotifyMask});
-    for (Client *c = d->head; c; c = c->next) if (c != d->curr) XUnmapWindow(dis, c->win);
-    if (d->curr) XUnmapWindow(dis, d->curr->win);
-    XChangeWindowAttributes(dis, root, CWEventMask, &(XSetWindowAttributes){.event_mask = ROOTMASK});
-    if (n->head) { tile(n); focus(n->curr, n); }
-    desktopinfo();
+    if (arg->i == currdeskidx || arg->i < 0 || arg->i >= ndesktops) return;
+    if (!deskmon(arg->i)) showdesktop(deskmon(currdeskidx), arg->i);
+    prevdeskidx = currdeskidx;
+    Desktop *n = &desktops[(currdeskidx = arg->i)];
+    if (n->count) focus(n->curr, n); else n->dirty = True;
+}
+
+/**
+ * focus the monitor with the given index, and the desktop it shows
+ */
+void change_monitor(const Arg *arg) {
+    if (arg->i >= 0 && arg->i < nmonitors) change_desktop(&(Arg){.i = monitors[arg->i].desk});
 }
 
+#ifdef DEBUG
+/**
+ * verify that the window index agrees with the client lists of the
+ * desktops; every listed client must be found through wintoclient on
+ * the desktop it is listed on, at the position it is listed at, and
+ * the index must hold nothing else; the filled desktops must be the
+ * ones that have clients
+ */
+void checkindex(void) {
+    int n = 0;
+    for (unsigned int i = 0; i < LENGTH(wintable); i++)
+        for (Client *c = wintable[i]; c; c = c->hnext, n++) if (WINSLOT(c->win) != i)
+            errx(EXIT_FAILURE, "checkindex: window 0x%lx is in the wrong bucket", c->win);
+    for (int i = 0, f = 0; i < ndesktops; i++) {
+        if (desktops[i].count && (f >= nfilled || filled[f++] != i))
+            errx(EXIT_FAILURE, "checkindex: desktop %d is not marked filled", i);
+        if (i == ndesktops - 1 && f != nfilled)
+            errx(EXIT_FAILURE, "checkindex: %d empty desktops marked filled", nfilled - f);
+    }
+    for (int i = 0; i < ndesktops; i++) for (int k = 0; k < desktops[i].count; k++, n--) {
+        Desktop *d = NULL; Client *t = NULL, *c = desktops[i].list[k];
+        if (!wintoclient(c->win, &t, &d) || t != c || d != &desktops[i] || c->pos != k)
+            errx(EXIT_FAILURE, "checkindex: window 0x%lx is not indexed on desktop %d", c->win, i);
+    }
+    if (n) errx(EXIT_FAILURE, "checkindex: %d stale entries in the window index", n);
+}
+#endif
+
 /**
  * remove all windows in all desktops by sending a delete window message
+ *
+ * when quitting to restart (exit value 0) the windows are left alone,
+ * so that they are adopted by the next instance (see scan), the
+ * server puts them back on the root window as they are in the save-set
+ *
+ * the control socket is closed and removed
  */
 void cleanup(void) {
-    Window root_return, parent_return, *children;
-    unsigned int nchildren;
+    for (unsigned int i = 0; i < LENGTH(conns); i++) if (conns[i].fd >= 0) close(conns[i].fd);
+    if (sock >= 0) { close(sock); unlink(sockaddr.sun_path); }
 
     XUngrabKey(dis, AnyKey, AnyModifier, root);
-    XQueryTree(dis, root, &root_return, &parent_return, &children, &nchildren);
-    for (unsigned int i = 0; i < nchildren; i++) deletewindow(children[i]);
-    if (children) XFree(children);
+    for (int i = 0; retval && i < ndesktops; i++)
+        for (int k = 0; k < desktops[i].count; k++) deletewindow(desktops[i].list[k]->win);
     XSync(dis, False);
 }
 
 /**
  * move the current focused client to another desktop
  *
- * add the current client as the last on the new desktop
- * then remove it from the current desktop
+ * remove the current client from the current desktop
+ * then add it as the last on the new desktop
  */
 void client_to_desktop(const Arg *arg) {
-    if (arg->i == currdeskidx || arg->i < 0 || arg->i >= DESKTOPS || !desktops[currdeskidx].curr) return;
+    if (arg->i == currdeskidx || arg->i < 0 || arg->i >= ndesktops || !desktops[currdeskidx].curr) return;
     Desktop *d = &desktops[currdeskidx], *n = &desktops[arg->i];
-    Client *c = d->curr, *p = prevclient(d->curr, d), *l = prevclient(n->head, n);
+    Client *c = d->curr;
 
     /* unlink current client from current desktop */
-    if (d->head == c || !p) d->head = c->next; else p->next = c->next;
-    c->next = NULL;
-    XChangeWindowAttributes(dis, root, CWEventMask, &(XSetWindowAttributes){.do_not_propagate_mask = SubstructureNotifyMask});
-    if (XUnmapWindow(dis, c->win)) focus(d->prev, d);
-    XChangeWindowAttributes(dis, root, CWEventMask, &(XSetWindowAttributes){.event_mask = ROOTMASK});
-    if (!(c->isfloat || c->istrans) || (d->head && !d->head->next)) tile(d);
-
-    /* link client to new desktop and make it the current */
-    focus(l ? (l->next = c):n->head ? (n->head->next = c):(n->head = c), n);
-
-    if (FOLLOW_WINDOW) change_desktop(arg); else desktopinfo();
+    detach(c, d);
+    c->stackpos = 0;
+    ewmh.restacked = True;
+    if (d->focused == c) d->focused = NULL;
+    focus(d->prev, d);
+    if (!(c->isfloat || c->istrans) || d->count == 1) tile(d);
+
+    /* link client to new desktop and make it the current, its window moves to the new container */
+    attach(c, n, n->count);
+    reparent(c, d, True);
+    if (c->isurgn) { d->urgent--; n->urgent++; }
+    XChangeProperty(dis, c->win, netatoms[NET_WM_DESKTOP], XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)&(long){c->desk}, 1);
+    tile(n);
+    focus(c, n);
+
+    if (FOLLOW_WINDOW) change_desktop(arg);
 }
 
 /**
@@ -340,19 +813,195 @@ void client_to_desktop(const Arg *arg) {
  * is received and a client holding that window exists,
  * the window becomes the current active focused window
  * on its desktop.
+ *
+ * a pager may change the number of desktops by sending
+ * a _NET_NUMBER_OF_DESKTOPS message to the root window
+ * with the new number in data.l[0], see set_desktops,
+ * and switch desktops with a _NET_CURRENT_DESKTOP message
  */
 void clientmessage(XEvent *e) {
     Desktop *d = NULL; Client *c = NULL;
+    if (e->xclient.window == root && e->xclient.message_type == netatoms[NET_NUMBER_DESKTOPS])
+        set_desktops(&(Arg){.i = e->xclient.data.l[0]});
+    if (e->xclient.window == root && e->xclient.message_type == netatoms[NET_CURRENT_DESKTOP])
+        change_desktop(&(Arg){.i = e->xclient.data.l[0]});
     if (!wintoclient(e->xclient.window, &c, &d)) return;
+    tagwindow(c->win);
 
     if (e->xclient.message_type        == netatoms[NET_WM_STATE] && (
         (unsigned)e->xclient.data.l[1] == netatoms[NET_FULLSCREEN]
      || (unsigned)e->xclient.data.l[2] == netatoms[NET_FULLSCREEN])) {
         setfullscreen(c, d, (e->xclient.data.l[0] == 1 || (e->xclient.data.l[0] == 2 && !c->isfull)));
-        if (!(c->isfloat || c->istrans) || !d->head->next) tile(d);
+        tile(d);
     } else if (e->xclient.message_type == netatoms[NET_ACTIVE]) focus(c, d);
 }
 
+/**
+ * read an integer argument of the given command into v
+ * return False if it is not a number in the range the command accepts
+ */
+Bool cmdarg(const Command *c, const char *s, int *v) {
+    char *end = NULL;
+    long l = strtol(s, &end, 10);
+    if (end == s || *end || l < c->min || l > c->max) return False;
+    *v = l;
+    return True;
+}
+
+/**
+ * merge the newest queued event (q[n]) with older events in the
+ * queue that it makes redundant. the older events are discarded
+ * by zeroing their type, as there is no handler for type zero.
+ *
+ *  - a configure request keeps the values of the older requests
+ *    for the same window that it does not itself override
+ *  - only the last change of a property of a window is kept
+ *  - only the last crossing and focus events of a window are kept
+ *  - only the last change of the keyboard or modifier mapping is kept,
+ *    as a refresh of either mapping is a refresh of all of it
+ */
+void coalesce(XEvent *q, int n) {
+    XConfigureRequestEvent *c = &q[n].xconfigurerequest, *o = NULL;
+    for (int i = 0; i < n; i++) if (q[i].type == q[n].type) switch (q[n].type) {
+        case ConfigureRequest:
+            if ((o = &q[i].xconfigurerequest)->window != c->window) break;
+            if (!(c->value_mask & CWX)           && (o->value_mask & CWX))           c->x = o->x;
+            if (!(c->value_mask & CWY)           && (o->value_mask & CWY))           c->y = o->y;
+            if (!(c->value_mask & CWWidth)       && (o->value_mask & CWWidth))       c->width = o->width;
+            if (!(c->value_mask & CWHeight)      && (o->value_mask & CWHeight))      c->height = o->height;
+            if (!(c->value_mask & CWBorderWidth) && (o->value_mask & CWBorderWidth)) c->border_width = o->border_width;
+            if (!(c->value_mask & CWSibling)     && (o->value_mask & CWSibling))     c->above = o->above;
+            if (!(c->value_mask & CWStackMode)   && (o->value_mask & CWStackMode))   c->detail = o->detail;
+            c->value_mask |= o->value_mask;
+            q[i].type = 0;
+            break;
+        case PropertyNotify:
+            if (q[i].xproperty.window == q[n].xproperty.window
+             && q[i].xproperty.atom   == q[n].xproperty.atom) q[i].type = 0;
+            break;
+        case EnterNotify:
+            if (q[i].xcrossing.window == q[n].xcrossing.window) q[i].type = 0;
+            break;
+        case FocusIn:
+            if (q[i].xfocus.window == q[n].xfocus.window) q[i].type = 0;
+            break;
+        case MappingNotify:
+            if (q[i].xmapping.request == q[n].xmapping.request) q[i].type = 0;
+            break;
+        case ConfigureNotify:
+            if (q[i].xconfigure.window == root && q[n].xconfigure.window == root) q[i].type = 0;
+            break;
+    }
+}
+
+/**
+ * apply the deferred changes of the desktops touched by the last
+ * batch of events, so that each desktop has its focus updated at
+ * most once per batch, then flush.
+ *
+ * the shown desktops are tiled only if their layout generation moved
+ * since they were last tiled, thus a desktop shown again unchanged, or
+ * asked to be tiled many times in a batch, is tiled at most once.
+ * hidden desktops are tiled when they are shown.
+ *
+ * the client lists and current desktop published for pagers and panels
+ * are updated once per batch as well (see updateewmh).
+ *
+ * restacking may put a different window under the pointer, so
+ * if focus follows the mouse, the crossing events generated by
+ * the restacking are ignored (see enternotify).
+ *
+ * the output is flushed without waiting for the server to process it,
+ * errors are matched to the requests that caused them (see xerror).
+ */
+void commit(void) {
+#ifdef METRICS
+    unsigned long req = NextRequest(dis), rt = roundtrips;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+#endif
+    for (int i = 0; i < nmonitors; i++) {
+        Desktop *d = &desktops[monitors[i].desk];
+        if (d->tgen != d->gen) { arrange(d); d->tgen = d->gen; }
+    }
+    for (int i = -1; i < nfilled; i++) {
+        if (i >= 0 && filled[i] == currdeskidx) continue;
+        Desktop *d = &desktops[i < 0 ? currdeskidx:filled[i]];
+        if (d->dirty) refocus(d);
+        d->dirty = False;
+    }
+    updateewmh();
+    desktopinfo();
+    XFlush(dis);
+#ifdef METRICS
+    gettimeofday(&end, NULL);
+    record(LASTEvent, (end.tv_sec - start.tv_sec) * 1000000L + end.tv_usec - start.tv_usec,
+           NextRequest(dis) - req, roundtrips - rt);
+#endif
+}
+
+/**
+ * compile the app rules of the settings once, so that matching a window
+ * (see matchrule) takes a few exact comparisons instead of a scan of them
+ *
+ * the rules are chained by the hash of their class, or of their instance
+ * if they have no class, in order. the title and role patterns are
+ * compiled and the type names interned, all in one round trip
+ */
+Bool compilerules(Config *c) {
+    char *names[c->nrules + 1];
+    Atom atoms[c->nrules + 1];
+    int n = 0;
+
+    if (!(c->rulenext = calloc(c->nrules + 1, sizeof *c->rulenext)) || !(c->ruletype = calloc(c->nrules + 1, sizeof(Atom)))
+        || !(c->ruletitle = calloc(c->nrules + 1, sizeof(regex_t))) || !(c->rulerole = calloc(c->nrules + 1, sizeof(regex_t))))
+        err(EXIT_FAILURE, "cannot allocate rules");
+    for (; c->compiled < c->nrules; c->compiled++) {
+        const AppRule *r = &c->rules[c->compiled];
+        if (r->title && regcomp(&c->ruletitle[c->compiled], r->title, REG_EXTENDED|REG_NOSUB)) {
+            warnx("bad title pattern in rule %u: %s", c->compiled, r->title);
+            return False;
+        }
+        if (r->role && regcomp(&c->rulerole[c->compiled], r->role, REG_EXTENDED|REG_NOSUB)) {
+            if (r->title) regfree(&c->ruletitle[c->compiled]);
+            warnx("bad role pattern in rule %u: %s", c->compiled, r->role);
+            return False;
+        }
+    }
+    for (unsigned int i = c->nrules; i-- > 0;) {
+        const AppRule *r = &c->rules[i];
+        const char *key = r->class ? r->class:r->instance;
+        unsigned short *first = key ? &c->rulefirst[strhash(key)]:&c->ruleany;
+        c->rulenext[i] = *first;
+        *first = i + 1;
+        if (r->type) names[n++] = (char *)r->type;
+        c->fetchtitle |= r->title != NULL;
+        c->fetchrole |= r->role != NULL;
+        c->fetchtype |= r->type != NULL;
+    }
+    if (n) XInternAtoms(dis, names, n, False, atoms);
+    for (unsigned int i = 0; i < c->nrules; i++) if (c->rules[i].type) c->ruletype[i] = atoms[--n];
+    return True;
+}
+
+/**
+ * a window's size, position or border width changed.
+ *
+ * keep the geometry of the client holding the window in sync with the
+ * server, unless the notification predates the last request the wm
+ * made to configure the window, in which case it is already stale.
+ *
+ * when the root window changed, the screen was resized, so the
+ * monitors are read again (see updategeometry).
+ */
+void configurenotify(XEvent *e) {
+    XConfigureEvent *ev = &e->xconfigure;
+    Desktop *d = NULL; Client *c = NULL;
+    if (ev->window == root) { updategeometry(ev->width, ev->height); return; }
+    if (!wintoclient(ev->window, &c, &d) || ev->serial < c->serial) return;
+    c->x = ev->x + d->cx; c->y = ev->y + d->cy; c->w = ev->width; c->h = ev->height; c->bw = ev->border_width;
+}
+
 /**
  * configure a window's size, position, border width, and stacking order.
  *
@@ -375,15 +1024,22 @@ void clientmessage(XEvent *e) {
  * some windows implement window manager functions themselves.
  * that is windows explicitly steal focus, or manage subwindows,
  * or move windows around w/o the window manager's help, etc..
- * to disallow this behavior, we 'tile()' the desktop to which
- * the window that sent the configure request belongs.
+ * to disallow this behavior, the request of a window whose geometry
+ * is imposed by the wm (tiled or fullscreen) is not applied. instead
+ * the window is told its current geometry, with a synthetic configure
+ * notify, as it is described in the ICCCM. floating windows, and
+ * windows not managed yet, get what they asked for.
  */
 void configurerequest(XEvent *e) {
     XConfigureRequestEvent *ev = &e->xconfigurerequest;
     XWindowChanges wc = { ev->x, ev->y,  ev->width, ev->height, ev->border_width, ev->above, ev->detail };
-    if (XConfigureWindow(dis, ev->window, ev->value_mask, &wc)) XSync(dis, False);
     Desktop *d = NULL; Client *c = NULL;
-    if (wintoclient(ev->window, &c, &d)) tile(d);
+    tagwindow(ev->window);
+    if (wintoclient(ev->window, &c, &d) && (c->isfull || (!ISFFT(c) && d->mode != FLOAT))) { sendconfigure(c); return; }
+    if (c) c->serial = NextRequest(dis);
+    if (c && (ev->value_mask & CWStackMode)) c->stackpos = 0, d->sorted = False, ewmh.restacked = True; /* it moves to where the wm does not know */
+    if (c) { wc.x -= d->cx; wc.y -= d->cy; } /* the client asks in root coordinates */
+    XConfigureWindow(dis, ev->window, ev->value_mask, &wc);
 }
 
 /**
@@ -398,9 +1054,19 @@ void deletewindow(Window w) {
     ev.xclient.message_type = wmatoms[WM_PROTOCOLS];
     ev.xclient.data.l[0]    = wmatoms[WM_DELETE_WINDOW];
     ev.xclient.data.l[1]    = CurrentTime;
+    tagwindow(w);
     XSendEvent(dis, w, False, NoEventMask, &ev);
 }
 
+/**
+ * get the monitor showing the given desktop
+ * if the desktop is hidden, return NULL
+ */
+Monitor* deskmon(int i) {
+    for (int k = 0; k < nmonitors; k++) if (monitors[k].desk == i) return &monitors[k];
+    return NULL;
+}
+
 /**
  * output info about the desktops on standard output stream
  *
@@ -414,18 +1080,33 @@ void deletewindow(Window w) {
  *   - whether the desktop is the current focused (1) or not (0)
  *   - whether any client in that desktop has received an urgent hint
  *
- * once the info is collected, immediately flush the stream
+ * with EXTENDED_INFO set, the class and the title of the current
+ * window follow, each separated from what precedes by a tab.
+ *
+ * called once for every batch of events (see commit), a line is
+ * only output when it differs from the previous one. the line is
+ * queued rather than written out right away (see flushinfo), and
+ * sent to the subscribers of the control socket (see runcommand).
  */
 void desktopinfo(void) {
-    Desktop *d = NULL;
-    Client *c = NULL;
-    Bool urgent = False;
-
-    for (int w = 0, i = 0; i < DESKTOPS; i++, w = 0, urgent = False) {
-        for (d = &desktops[i], c = d->head; c; urgent |= c->isurgn, ++w, c = c->next);
-        printf("%d:%d:%d:%d:%d%c", i, w, d->mode, i == currdeskidx, urgent, i == DESKTOPS-1 ? '\n':' ');
-    }
-    fflush(stdout);
+    char s[sizeof info.line];
+    const Client *c = desktops[currdeskidx].curr;
+    int n = 0;
+
+    for (int i = 0; i < ndesktops && n < (int)sizeof s; i++)
+        n += snprintf(s + n, sizeof s - n, "%d:%d:%d:%d:%d%s", i, desktops[i].count, desktops[i].mode,
+                      i == currdeskidx, desktops[i].urgent > 0, i == ndesktops-1 ? "":" ");
+    if (EXTENDED_INFO && n < (int)sizeof s)
+        n += snprintf(s + n, sizeof s - n, "\t%s\t%s", c ? c->class:"", c ? c->title:"");
+    if (n > (int)sizeof s - 2) n = sizeof s - 2;
+    for (int i = 0; i < n; i++) if (s[i] == '\n') s[i] = ' ';
+    s[n++] = '\n'; s[n] = '\0';
+
+    if (!strcmp(s, info.line)) return;
+    memcpy(info.line, s, n + 1);
+    info.queued = True;
+    flushinfo();
+    for (unsigned int i = 0; i < LENGTH(conns); i++) if (conns[i].fd >= 0 && conns[i].sub) sendline(i, info.line);
 }
 
 /**
@@ -439,36 +1120,111 @@ void destroynotify(XEvent *e) {
     if (wintoclient(e->xdestroywindow.window, &c, &d)) removeclient(c, d);
 }
 
+/**
+ * take the client out of the desktop's client list
+ * the clients after it are moved one position up
+ * the last client leaving marks the desktop empty
+ */
+void detach(Client *c, Desktop *d) {
+    d->sorted = False;
+    memmove(d->list + c->pos, d->list + c->pos + 1, (--d->count - c->pos) * sizeof(Client *));
+    for (int i = c->pos; i < d->count; i++) d->list[i]->pos = i;
+    if (d->count) return;
+    int k = 0;
+    while (filled[k] != d - desktops) k++;
+    memmove(filled + k, filled + k + 1, (--nfilled - k) * sizeof(int));
+}
+
 /**
  * when the mouse enters a window's borders, that window,
  * if has set notifications of such events (EnterWindowMask)
  * will notify that the pointer entered its region
  * and will get focus if FOLLOW_MOUSE is set in the config.
+ *
+ * crossing events caused by restacking the windows on focus
+ * carry the serial of one of the restack requests and are ignored.
  */
 void enternotify(XEvent *e) {
-    Desktop *d = NULL; Client *c = NULL, *p = NULL;
+    Desktop *d = NULL; Client *c = NULL;
 
-    if (!FOLLOW_MOUSE || (e->xcrossing.mode != NotifyNormal && e->xcrossing.detail == NotifyInferior)
+    if (!FOLLOW_MOUSE || (e->xcrossing.serial >= restacked[0] && e->xcrossing.serial < restacked[1])
+        || (e->xcrossing.mode != NotifyNormal && e->xcrossing.detail == NotifyInferior)
         || !wintoclient(e->xcrossing.window, &c, &d) || e->xcrossing.window == d->curr->win) return;
 
-    if ((p = d->prev))
-        XChangeWindowAttributes(dis, p->win, CWEventMask, &(XSetWindowAttributes){.do_not_propagate_mask = EnterWindowMask});
+    if (c->desk != currdeskidx) change_desktop(&(Arg){.i = c->desk});
     focus(c, d);
-    if (p) XChangeWindowAttributes(dis, p->win, CWEventMask, &(XSetWindowAttributes){.event_mask = EnterWindowMask});
 }
 
 /**
- * 1. set current/active/focused and previously focused client
- *    in other words, manage curr and prev references
- * 2. restack clients
- * 3. highlight borders and set active window property
- * 4. give input focus to the current/active/focused client
+ * fit the container of the desktop to the monitor that shows it, panel
+ * included. the windows in it move along, and are tiled again after.
+ * the server does not tell the windows they moved, the wm does
+ */
+void fitcontainer(Desktop *d, const Monitor *m) {
+    int h = m->h + PANEL_HEIGHT;
+    Bool moved = d->cx != m->x || d->cy != m->y;
+    if (!moved && d->cw == m->w && d->ch == h) return;
+    for (int k = 0; k < d->count; k++) { d->list[k]->x += m->x - d->cx; d->list[k]->y += m->y - d->cy; }
+    XMoveResizeWindow(dis, d->cont, (d->cx = m->x), (d->cy = m->y), (d->cw = m->w), (d->ch = h));
+    for (int k = 0; moved && k < d->count; k++) sendconfigure(d->list[k]);
+}
+
+/**
+ * write out as much of the status line as the reader takes without blocking
+ *
+ * a write is only made when the reader is ready for it, and never of
+ * more than PIPE_BUF bytes, which then cannot block. standard output
+ * itself is left blocking, as it is shared with the spawned commands.
+ * so a panel that does not keep up cannot stall the wm. the line that
+ * is being written is completed first, when the reader is ready again
+ * (see run). of the lines made meanwhile only the newest one is kept,
+ * the older ones being stale. once the reader goes away nothing more
+ * is written.
+ */
+void flushinfo(void) {
+    while (!info.closed) {
+        if (info.off == info.len) {
+            if (!info.queued) return;
+            info.len = strlen(strcpy(info.out, info.line));
+            info.off = 0;
+            info.queued = False;
+        }
+        struct pollfd fd = { STDOUT_FILENO, POLLOUT, 0 };
+        if (poll(&fd, 1, 0) <= 0) return;
+        if (fd.revents & POLLNVAL) { info.closed = True; return; }
+        ssize_t n = write(STDOUT_FILENO, info.out + info.off, MIN(info.len - info.off, PIPE_BUF));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n < 0) info.closed = True; else info.off += n;
+    }
+}
+
+/**
+ * release what the settings hold
+ */
+void freeconfig(Config *c) {
+    for (unsigned int i = 0; i < c->compiled; i++) {
+        if (c->rules[i].title) regfree(&c->ruletitle[i]);
+        if (c->rules[i].role) regfree(&c->rulerole[i]);
+    }
+    free(c->rulenext); free(c->ruletitle); free(c->rulerole); free(c->ruletype);
+    free(c->keys); free(c->rules); free(c->args);
+    free(c->buf);
+    *c = (Config){ .buf = NULL };
+}
+
+/**
+ * set current/active/focused and previously focused client
+ * in other words, manage curr and prev references
+ *
+ * the rest of the work - restacking clients, highlighting borders,
+ * setting the active window property and giving input focus - is
+ * deferred to the end of the event batch (see commit and refocus)
  */
 void focus(Client *c, Desktop *d) {
     /* update references to prev and curr,
      * previously focused and currently focused clients.
      *
-     * if there are no clients (!head) or the new client
+     * if there are no clients (!count) or the new client
      * is NULL, then delete the _NET_ACTIVE_WINDOW property
      *
      * if the new client is the prev client then
@@ -478,7 +1234,7 @@ void focus(Client *c, Desktop *d) {
      *    ie, two consecutive clients were focused
      *    and then prev_win() was called, to focus
      *    the previous from current client, which
-     *    happens to be prev (curr == c->next).
+     *    happens to be prev (curr is next from c).
      * (below: h:head p:prev c:curr)
      *
      * [h]->[p]->[c]->NULL   ===>   [h|p]->[c]->NULL
@@ -508,51 +1264,11 @@ void focus(Client *c, Desktop *d) {
      * All other reference changes for curr and prev
      * should and are handled here.
      */
-    if (!d->head || !c) { /* no clients - no active window - nothing to do */
-        XDeleteProperty(dis, root, netatoms[NET_ACTIVE]);
-        d->curr = d->prev = NULL;
-        return;
-    } else if (d->prev == c && d->curr != c->next) { d->prev = prevclient((d->curr = c), d);
-    } else if (d->curr != c) { d->prev = d->curr; d->curr = c; }
-
-    /* restack clients
-     *
-     * stack order is based on client properties.
-     * from top to bottom:
-     *  - current when floating or transient
-     *  - floating or trancient windows
-     *  - current when tiled
-     *  - current when fullscreen
-     *  - fullscreen windows
-     *  - tiled windows
-     *
-     * num of n:all fl:fullscreen ft:floating/transient windows
-     */
-    int n = 0, fl = 0, ft = 0;
-    for (c = d->head; c; c = c->next, ++n) if (ISFFT(c)) { fl++; if (!c->isfull) ft++; }
-    Window w[n];
-    w[(d->curr->isfloat || d->curr->istrans) ? 0:ft] = d->curr->win;
-    for (fl += !ISFFT(d->curr) ? 1:0, c = d->head; c; c = c->next) {
-        XSetWindowBorder(dis, c->win, c == d->curr ? win_focus:win_unfocus);
-        /*
-         * a window should have borders in any case, except if
-         *  - the window is fullscreen
-         *  - the window is not floating or transient and
-         *      - the mode is MONOCLE or,
-         *      - it is the only window on screen
-         */
-        XSetWindowBorderWidth(dis, c->win, c->isfull || (!ISFFT(c) &&
-            (d->mode == MONOCLE || !d->head->next)) ? 0:BORDER_WIDTH);
-        if (c != d->curr) w[c->isfull ? --fl:ISFFT(c) ? --ft:--n] = c->win;
-        if (CLICK_TO_FOCUS || c == d->curr) grabbuttons(c);
-    }
-    XRestackWindows(dis, w, LENGTH(w));
-
-    XSetInputFocus(dis, d->curr->win, RevertToPointerRoot, CurrentTime);
-    XChangeProperty(dis, root, netatoms[NET_ACTIVE], XA_WINDOW, 32,
-                    PropModeReplace, (unsigned char *)&d->curr->win, 1);
-
-    XSync(dis, False);
+    if (!d->count || !c) d->curr = d->prev = NULL; /* no clients - no active window */
+    else if (d->prev == c && d->curr != (c->pos + 1 < d->count ? d->list[c->pos + 1]:NULL))
+        d->prev = prevclient((d->curr = c), d);
+    else if (d->curr != c) { d->prev = d->curr; d->curr = c; }
+    d->dirty = True;
 }
 
 /**
@@ -576,20 +1292,41 @@ void focusin(XEvent *e) {
  */
 void focusurgent(void) {
     Client *c = NULL;
-    int d = -1;
-    for (c = desktops[currdeskidx].head; c && !c->isurgn; c = c->next);
-    while (!c && d < DESKTOPS-1) for (c = desktops[++d].head; c && !c->isurgn; c = c->next);
-    if (c) { if (d != -1) change_desktop(&(Arg){.i = d}); focus(c, &desktops[currdeskidx]); }
+    int d = currdeskidx;
+    for (int i = 0; !desktops[d].urgent && i < nfilled; i++) d = filled[i];
+    if (!desktops[d].urgent) return;
+    for (int i = 0; !c && i < desktops[d].count; i++) if (desktops[d].list[i]->isurgn) c = desktops[d].list[i];
+    if (d != currdeskidx) change_desktop(&(Arg){.i = d});
+    focus(c, &desktops[currdeskidx]);
 }
 
 /**
  * get a pixel with the requested color to
  * fill some window area (such as borders)
+ *
+ * the color names of the config file are known to be valid (see
+ * readconfig), but the colormap may be full, then the given pixel is kept
  */
-unsigned long getcolor(const char* color, const int screen) {
-    XColor c; Colormap map = DefaultColormap(dis, screen);
-    if (!XAllocNamedColor(dis, map, color, &c, &c)) err(EXIT_FAILURE, "cannot allocate color");
-    return c.pixel;
+unsigned long getcolor(const char* color, unsigned long pixel) {
+    XColor c; Colormap map = DefaultColormap(dis, DefaultScreen(dis));
+    if (XAllocNamedColor(dis, map, color, &c, &c)) return c.pixel;
+    warnx("cannot allocate color %s", color);
+    return pixel;
+}
+
+/**
+ * get the title of a window, its _NET_WM_NAME or else its WM_NAME
+ */
+void gettitle(Window w, char *title, size_t len) {
+    Atom props[] = { netatoms[NET_WM_NAME], XA_WM_NAME }, a;
+    int f; unsigned long l, r; unsigned char *v = NULL;
+    *title = '\0';
+    for (unsigned int i = 0; i < LENGTH(props) && !*title; i++, v = NULL) {
+        if (XGetWindowProperty(dis, w, props[i], 0L, len/4, False, AnyPropertyType,
+                               &a, &f, &l, &r, &v) == Success && v && f == 8)
+            snprintf(title, len, "%.*s", (int)l, (char *)v);
+        if (v) XFree(v);
+    }
 }
 
 /**
@@ -598,18 +1335,33 @@ unsigned long getcolor(const char* color, const int screen) {
  * the wm listens to those button bindings and
  * calls an appropriate handler when a binding
  * occurs (see buttonpress).
+ *
+ * the client keeps track of what is grabbed on its window, so only
+ * what changed is requested. the buttons of the bindings are grabbed
+ * once, when the window is managed, and again only if the numlock
+ * modifier changes (see mappingnotify). with CLICK_TO_FOCUS the focus
+ * button is grabbed while the client is not its desktop's current, so
+ * a focus change only ungrabs it from the new current client and
+ * grabs it on the previous one.
  */
 void grabbuttons(Client *c) {
     unsigned int b, m, modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+    Bool fbtn = CLICK_TO_FOCUS && c != desktops[c->desk].curr;
+
+    if (!c->hasbtns || c->numlock != numlockmask) {
+        XUngrabButton(dis, AnyButton, AnyModifier, c->win);
+        for (b = 0, m = 0; b < LENGTH(buttons); b++, m = 0) while (m < LENGTH(modifiers))
+            XGrabButton(dis, buttons[b].button, buttons[b].mask|modifiers[m++], c->win,
+                          False, BUTTONMASK, GrabModeAsync, GrabModeAsync, None, None);
+        c->hasbtns = True; c->hasfbtn = False; c->numlock = numlockmask;
+    }
+    if (fbtn == c->hasfbtn) return;
 
-    for (m = 0; CLICK_TO_FOCUS && m < LENGTH(modifiers); m++)
-        if (c != desktops[currdeskidx].curr) XGrabButton(dis, FOCUS_BUTTON, modifiers[m],
+    for (m = 0; m < LENGTH(modifiers); m++)
+        if (fbtn) XGrabButton(dis, FOCUS_BUTTON, modifiers[m],
                 c->win, False, BUTTONMASK, GrabModeAsync, GrabModeAsync, None, None);
         else XUngrabButton(dis, FOCUS_BUTTON, modifiers[m], c->win);
-
-    for (b = 0, m = 0; b < LENGTH(buttons); b++, m = 0) while (m < LENGTH(modifiers))
-        XGrabButton(dis, buttons[b].button, buttons[b].mask|modifiers[m++], c->win,
-                      False, BUTTONMASK, GrabModeAsync, GrabModeAsync, None, None);
+    c->hasfbtn = fbtn;
 }
 
 /**
@@ -618,32 +1370,60 @@ void grabbuttons(Client *c) {
  * the wm listens to those key bindings and
  * calls an appropriate handler when a binding
  * occurs (see keypressed).
+ *
+ * the keycode of each binding is looked up once, and the bindings of
+ * each keycode are chained so a key press finds them directly.
+ * as a key press is matched by the keysym of the first level of its
+ * keycode, only the bindings with that keysym are chained. a binding on
+ * a shifted keysym of the same key, as XK_exclam on the key of XK_1, is
+ * grabbed but never fires, and does not fire for the unshifted one.
+ * also find the modifier numlock is on, as bindings are grabbed with
+ * and without it. when the mapping changes (see mappingnotify) only
+ * the bindings whose keycode changed are grabbed again, unless the
+ * numlock modifier changed, as that affects all of them.
  */
 void grabkeys(void) {
-    KeyCode code;
-    XUngrabKey(dis, AnyKey, AnyModifier, root);
-    unsigned int k, m, modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+    unsigned int k, m, old = numlockmask;
+    KeyCode code[conf.nkeys + 1], numlock = XKeysymToKeycode(dis, XK_Num_Lock);
 
-    for (k = 0, m = 0; k < LENGTH(keys); k++, m = 0)
-        while ((code = XKeysymToKeycode(dis, keys[k].keysym)) && m < LENGTH(modifiers))
-            XGrabKey(dis, code, keys[k].mod|modifiers[m++], root, True, GrabModeAsync, GrabModeAsync);
+    XModifierKeymap *modmap = XGetModifierMapping(dis);
+    for (numlockmask = 0, k = 0; k < 8; k++) for (int j = 0; j < modmap->max_keypermod; j++)
+        if (numlock && modmap->modifiermap[modmap->max_keypermod*k + j] == numlock) numlockmask = (1 << k);
+    XFreeModifiermap(modmap);
+    unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask },
+                 oldmodifiers[] = { 0, LockMask, old, old|LockMask };
+
+    /* release all the changed bindings before grabbing any,
+     * as a binding may move to the keycode another one left */
+    for (k = 0; k < conf.nkeys; k++) {
+        code[k] = XKeysymToKeycode(dis, conf.keys[k].keysym);
+        if (keycodes[k] && (code[k] != keycodes[k] || old != numlockmask)) for (m = 0; m < LENGTH(modifiers); m++)
+            XUngrabKey(dis, keycodes[k], conf.keys[k].mod|oldmodifiers[m], root);
+    }
+
+    memset(keyfirst, 0, sizeof keyfirst);
+    for (k = conf.nkeys; k-- > 0;) {
+        if (code[k] && (code[k] != keycodes[k] || old != numlockmask)) for (m = 0; m < LENGTH(modifiers); m++)
+            XGrabKey(dis, code[k], conf.keys[k].mod|modifiers[m], root, True, GrabModeAsync, GrabModeAsync);
+        if ((keycodes[k] = code[k]) && XkbKeycodeToKeysym(dis, code[k], 0, 0) == conf.keys[k].keysym)
+            keynext[k] = keyfirst[code[k]], keyfirst[code[k]] = k + 1;
+    }
 }
 
 /**
  * grid mode / grid layout
  * arrange windows in a grid aka fair
  */
-void grid(int x, int y, int w, int h, const Desktop *d) {
-    int n = 0, cols = 0, cn = 0, rn = 0, i = -1;
-    for (Client *c = d->head; c; c = c->next) if (!ISFFT(c)) ++n;
-    for (cols = 0; cols <= n/2; cols++) if (cols*cols >= n) break; /* emulate square root */
-    if (n == 0) return; else if (n == 5) cols = 2;
-
-    int rows = n/cols, ch = h - BORDER_WIDTH, cw = (w - BORDER_WIDTH)/(cols ? cols:1);
-    for (Client *c = d->head; c; c = c->next) {
-        if (ISFFT(c)) continue; else ++i;
+void grid(__attribute__((unused)) int mode, int n, __attribute__((unused)) int masz,
+          __attribute__((unused)) int sasz, XRectangle a, int bw, XRectangle *r) {
+    int cols = sqrt(n), cn = 0, rn = 0;
+    if (cols*cols < n) cols++; /* round the square root up */
+    if (n == 5) cols = 2;
+
+    int rows = n/cols, ch = a.height - bw, cw = (a.width - bw)/cols;
+    for (int i = 0; i < n; i++) {
         if (i/rows + 1 > cols - n%cols) rows = n/cols + 1;
-        XMoveResizeWindow(dis, c->win, x + cn*cw, y + rn*ch/rows, cw - BORDER_WIDTH, ch/rows - BORDER_WIDTH);
+        r[i] = RECT(a.x + cn*cw, a.y + rn*ch/rows, cw - bw, ch/rows - bw);
         if (++rn >= rows) { rn = 0; cn++; }
     }
 }
@@ -651,29 +1431,90 @@ void grid(int x, int y, int w, int h, const Desktop *d) {
 /**
  * on the press of a key binding (see grabkeys)
  * call the appropriate handler
+ *
+ * only the bindings of the pressed keycode are looked at, those
+ * whose keysym is the first of the keycode (see grabkeys)
  */
 void keypress(XEvent *e) {
-    KeySym keysym = XkbKeycodeToKeysym(dis, e->xkey.keycode, 0, 0);
-    for (unsigned int i = 0; i < LENGTH(keys); i++)
-        if (keysym == keys[i].keysym && CLEANMASK(keys[i].mod) == CLEANMASK(e->xkey.state))
-            if (keys[i].func) keys[i].func(&keys[i].arg);
+    for (unsigned int k = keyfirst[e->xkey.keycode]; k; k = keynext[k - 1])
+        if (CLEANMASK(conf.keys[k - 1].mod) == CLEANMASK(e->xkey.state) && conf.keys[k - 1].func) {
+#ifdef BENCH
+            for (unsigned int i = 0; !bench.op && i < LENGTH(commands); i++)
+                if (commands[i].func == conf.keys[k - 1].func) bench.op = commands[i].name;
+#endif
+            conf.keys[k - 1].func(&conf.keys[k - 1].arg);
+        }
+}
+
+/**
+ * read the config file (again) and apply what changed
+ *
+ * the new settings replace the old ones as a whole, or not at all if the
+ * file has errors, when the compiled ones are used if there were none yet.
+ * only the bindings whose combination was added or dropped are grabbed or
+ * released (see grabkeys), the borders recolored only if a color changed,
+ * and the desktops tiled again only if the border width or master size
+ * changed.
+ */
+void loadconfig(void) {
+    Config n;
+    if (!readconfig(&n, confpath) && (conf.keys || !readconfig(&n, NULL))) return;
+
+    Bool regrab = n.nkeys != conf.nkeys, retile = n.borderwidth != conf.borderwidth || n.mastersize != conf.mastersize,
+         recolor = !conf.focus || strcmp(n.focus, conf.focus) || strcmp(n.unfocus, conf.unfocus);
+    for (unsigned int i = 0; !regrab && i < n.nkeys; i++)
+        regrab = n.keys[i].mod != conf.keys[i].mod || n.keys[i].keysym != conf.keys[i].keysym;
+
+    /* the bindings that are kept keep their grabs, those dropped are released,
+     * and a kept one that shared its grab with a dropped one is grabbed again */
+    KeyCode *codes = NULL;
+    Bool dropped[conf.nkeys + 1];
+    if (regrab && !(codes = calloc(n.nkeys + 1, sizeof(KeyCode)))) err(EXIT_FAILURE, "cannot allocate keys");
+    for (unsigned int i = 0, k = 0; regrab && i < conf.nkeys; i++, k = 0) {
+        while (k < n.nkeys && (n.keys[k].mod != conf.keys[i].mod || n.keys[k].keysym != conf.keys[i].keysym)) k++;
+        if (!(dropped[i] = k == n.nkeys)) codes[k] = keycodes[i];
+    }
+    for (unsigned int i = 0; regrab && i < conf.nkeys; i++) if (dropped[i] && keycodes[i]) {
+        for (unsigned int m = 0; m < 4; m++)
+            XUngrabKey(dis, keycodes[i], conf.keys[i].mod|(m & 1 ? LockMask:0)|(m & 2 ? numlockmask:0), root);
+        for (unsigned int k = 0; k < n.nkeys; k++) if (codes[k] == keycodes[i] && n.keys[k].mod == conf.keys[i].mod) codes[k] = 0;
+    }
+    freeconfig(&conf);
+    conf = n;
+
+    if (regrab) {
+        free(keycodes);
+        keycodes = codes;
+        if (!(keynext = realloc(keynext, (conf.nkeys + 1) * sizeof *keynext))) err(EXIT_FAILURE, "cannot allocate keys");
+        grabkeys();
+    }
+    if (recolor) {
+        win_focus = getcolor(conf.focus, win_focus);
+        win_unfocus = getcolor(conf.unfocus, win_unfocus);
+        for (int i = 0; i < nfilled; i++) for (int k = 0; k < desktops[filled[i]].count; k++) {
+            Client *c = desktops[filled[i]].list[k];
+            tagwindow(c->win);
+            XSetWindowBorder(dis, c->win, c == desktops[filled[i]].focused ? win_focus:win_unfocus);
+        }
+    }
+    if (retile) for (int i = 0; i < ndesktops; i++) { tile(&desktops[i]); desktops[i].dirty = True; }
 }
 
 /**
  * explicitly kill the current client - close the highlighted window
  * if the client accepts WM_DELETE_WINDOW requests send a delete message
  * otherwise forcefully kill and remove the client
+ *
+ * whether the client accepts those requests is known since it was
+ * mapped and kept up to date as its properties change (see propertynotify)
  */
 void killclient(void) {
     Desktop *d = &desktops[currdeskidx];
     if (!d->curr) return;
 
-    Atom *prot = NULL; int n = -1;
-    if (XGetWMProtocols(dis, d->curr->win, &prot, &n))
-        while(--n >= 0 && prot[n] != wmatoms[WM_DELETE_WINDOW]);
-    if (n < 0) { XKillClient(dis, d->curr->win); removeclient(d->curr, d); }
-    else deletewindow(d->curr->win);
-    if (prot) XFree(prot);
+    tagwindow(d->curr->win);
+    if (d->curr->candelete) deletewindow(d->curr->win);
+    else { XKillClient(dis, d->curr->win); removeclient(d->curr, d); }
 }
 
 /**
@@ -683,53 +1524,117 @@ void last_desktop(void) {
     change_desktop(&(Arg){.i = prevdeskidx});
 }
 
+/**
+ * create a client for the window on the given desktop
+ * and set it up from what is known about the window (see probe)
+ * the window's buttons are grabbed right away (see grabbuttons)
+ * and its border is given the unfocused color, until it is focused
+ *
+ * the window is put in the container of the desktop (see reparent),
+ * and in the save-set, so it is put back on the root if the wm dies
+ *
+ * the window is appended to the client list on the root right away,
+ * and on the current desktop to the stacking list too, as it is mapped
+ * on top. otherwise the stacking list follows at the end of the batch
+ * (see updateewmh)
+ */
+Client* manage(Window w, const Probe *p, Desktop *d, Bool floating) {
+    Client *c = addwindow(w, d);
+    c->x = p->x; c->y = p->y; c->w = p->w; c->h = p->h; c->bw = p->bw;
+    c->istrans = p->istrans;
+    c->candelete = p->candelete;
+    c->isfloat = floating || d->mode == FLOAT;
+    memcpy(c->class, p->class, sizeof c->class);
+    memcpy(c->title, p->title, sizeof c->title);
+    grabbuttons(c);
+    XSetWindowBorder(dis, c->win, win_unfocus);
+    XAddToSaveSet(dis, c->win);
+    reparent(c, NULL, p->viewable);
+    if (ewmh.count == ewmh.size && (!(ewmh.list = realloc(ewmh.list, (ewmh.size = ewmh.size ? 2*ewmh.size:64) * sizeof(Window)))
+        || !(ewmh.stack = realloc(ewmh.stack, ewmh.size * sizeof(Window))))) err(EXIT_FAILURE, "cannot allocate client list");
+    ewmh.list[ewmh.count++] = c->win;
+    XChangeProperty(dis, root, netatoms[NET_CLIENT_LIST], XA_WINDOW, 32, PropModeAppend, (unsigned char *)&c->win, 1);
+    if (d != &desktops[currdeskidx]) ewmh.restacked = True; /* it goes below the windows of the current desktop */
+    else XChangeProperty(dis, root, netatoms[NET_CLIENT_STACKING], XA_WINDOW, 32, PropModeAppend, (unsigned char *)&c->win, 1);
+    tile(d);
+    return c;
+}
+
 /**
  * a map request is received when a window wants to display itself.
  * if the window has override_redirect flag set,
  * then it should not be handled by the wm.
  * if the window already has a client then there is nothing to do.
  *
+ * everything needed to know about the window is requested at once (see probe).
+ *
  * match window class and/or install name against an app rule.
  * create a new client for the window and add it to the appropriate desktop.
  * set the floating, transient and fullscreen state of the client.
- * if the desktop in which the window is to be spawned is the current desktop
- * then display/map the window, else, if follow is set, focus the new desktop.
+ * the window is mapped in the container of its desktop, and shown as soon
+ * as the desktop is. if it is not shown and follow is set, focus the desktop.
  */
 void maprequest(XEvent *e) {
     Desktop *d = NULL; Client *c = NULL;
     Window w = e->xmaprequest.window;
-    XWindowAttributes wa = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    if (wintoclient(w, &c, &d) || (XGetWindowAttributes(dis, w, &wa) && wa.override_redirect)) return;
+    Probe p;
+    tagwindow(w);
+    if (wintoclient(w, &c, &d)) return;
+    probe(&w, &p, 1);
+    if (!p.valid || p.override) return;
+
+    const AppRule *r = matchrule(&p);
+    Bool follow = r && r->follow;
+    int newdsk = r && r->desktop >= 0 && r->desktop < ndesktops ? r->desktop:currdeskidx;
+
+    c = manage(w, &p, (d = &desktops[newdsk]), r && r->floating); /* from now on, use c->win */
+    const Monitor *m = deskmon(newdsk) ? deskmon(newdsk):deskmon(currdeskidx);
+    if (c->isfloat && !c->istrans) resize(c, m->x + (m->w - c->w)/2, m->y + (m->h - c->h)/2, c->w, c->h);
+    if (p.isfull) setfullscreen(c, d, True);
+
+    XMapWindow(dis, c->win);
+    if (!deskmon(newdsk) && follow) change_desktop(&(Arg){.i = newdsk});
+    focus(c, d);
+}
 
-    XClassHint ch = {0, 0};
-    Bool follow = False, floating = False;
-    int newdsk = currdeskidx;
+/**
+ * the keyboard or modifier mapping changed (ie through setxkbmap or xmodmap)
+ *
+ * refresh what xlib knows of the mapping and grab the key bindings again.
+ * the buttons are grabbed along with the numlock modifier as well,
+ * so if that changed, the buttons of every client are grabbed again.
+ */
+void mappingnotify(XEvent *e) {
+    XMappingEvent *ev = &e->xmapping;
+    unsigned int old = numlockmask;
+    if (ev->request != MappingKeyboard && ev->request != MappingModifier) return;
 
-    if (XGetClassHint(dis, w, &ch)) for (unsigned int i = 0; i < LENGTH(rules); i++)
-        if (strstr(ch.res_class, rules[i].class) || strstr(ch.res_name, rules[i].class)) {
-            if (rules[i].desktop >= 0 && rules[i].desktop < DESKTOPS) newdsk = rules[i].desktop;
-            follow = rules[i].follow, floating = rules[i].floating;
-            break;
-        }
-    if (ch.res_class) XFree(ch.res_class);
-    if (ch.res_name) XFree(ch.res_name);
-
-    c = addwindow(w, (d = &desktops[newdsk])); /* from now on, use c->win */
-    c->istrans = XGetTransientForHint(dis, c->win, &w);
-    if ((c->isfloat = (floating || d->mode == FLOAT)) && !c->istrans)
-        XMoveWindow(dis, c->win, (ww - wa.width)/2, (wh - wa.height)/2);
-
-    int i; unsigned long l; unsigned char *state = NULL; Atom a;
-    if (XGetWindowProperty(dis, c->win, netatoms[NET_WM_STATE], 0L, sizeof a,
-                False, XA_ATOM, &a, &i, &l, &l, &state) == Success && state)
-        setfullscreen(c, d, (*(Atom *)state == netatoms[NET_FULLSCREEN]));
-    if (state) XFree(state);
-
-    if (currdeskidx == newdsk) { if (!ISFFT(c)) tile(d); XMapWindow(dis, c->win); }
-    else if (follow) change_desktop(&(Arg){.i = newdsk});
-    focus(c, d);
+    XRefreshKeyboardMapping(ev);
+    grabkeys();
+    if (numlockmask != old) for (int i = 0; i < nfilled; i++) for (int k = 0; k < desktops[filled[i]].count; k++) {
+        Client *c = desktops[filled[i]].list[k];
+        tagwindow(c->win);
+        grabbuttons(c);
+    }
+}
 
-    if (!follow) desktopinfo();
+/**
+ * find the first app rule that matches the window
+ *
+ * only the rules keyed on the window's class or instance and those keyed
+ * on neither may match (see compilerules). each chain is in order, so it
+ * is walked up to its first match or the best match of the chains before
+ */
+const AppRule* matchrule(const Probe *p) {
+    unsigned int best = conf.nrules, first[] = { conf.rulefirst[strhash(p->class)], conf.rulefirst[strhash(p->instance)], conf.ruleany };
+    for (unsigned int i = 0; i < LENGTH(first); i++) for (unsigned int k = first[i]; k && k - 1 < best; k = conf.rulenext[k - 1]) {
+        const AppRule *r = &conf.rules[k - 1];
+        if ((!r->class || !strcmp(r->class, p->class)) && (!r->instance || !strcmp(r->instance, p->instance))
+            && (!r->title || !regexec(&conf.ruletitle[k - 1], p->title, 0, NULL, 0))
+            && (!r->role  || !regexec(&conf.rulerole[k - 1], p->role, 0, NULL, 0))
+            && (!r->type  || conf.ruletype[k - 1] == p->type)) { best = k - 1; break; }
+    }
+    return best < conf.nrules ? &conf.rules[best]:NULL;
 }
 
 /**
@@ -747,135 +1652,182 @@ void maprequest(XEvent *e) {
  * event handling is passed back to run() function.
  *
  * once a window has been moved or resized, it's marked as floating.
+ *
+ * the starting geometry is the one known to the wm (see resize),
+ * so no round trip is needed to get the window's attributes.
+ *
+ * queued motion is collapsed to the newest pointer position, and the
+ * window follows the pointer at most REFRESH_RATE times per second.
+ * if the pointer stops while the window lags behind, the window
+ * catches up once a frame has passed. debug builds report how far
+ * behind the pointer the window was.
+ *
+ * the window is in the container of its desktop, so it is clipped at
+ * the edge of the monitor while it is moved. a window dropped with its
+ * center on another monitor goes to the desktop shown there, which
+ * gets the focus.
  */
 void mousemotion(const Arg *arg) {
     Desktop *d = &desktops[currdeskidx];
-    XWindowAttributes wa;
     XEvent ev;
 
-    if (!d->curr || !XGetWindowAttributes(dis, d->curr->win, &wa)) return;
+    if (!d->curr) return;
+    int ox = d->curr->x, oy = d->curr->y, ow = d->curr->w, oh = d->curr->h;
 
-    if (arg->i == RESIZE) XWarpPointer(dis, d->curr->win, d->curr->win, 0, 0, 0, 0, --wa.width, --wa.height);
+    if (arg->i == RESIZE) XWarpPointer(dis, d->curr->win, d->curr->win, 0, 0, 0, 0, --ow, --oh);
     int rx, ry, c, xw, yh; unsigned int v; Window w;
-    if (!XQueryPointer(dis, root, &w, &w, &rx, &ry, &c, &c, &v) || w != d->curr->win) return;
+    if (!XQueryPointer(dis, d->cont, &w, &w, &rx, &ry, &c, &c, &v) || w != d->curr->win) return;
 
     if (XGrabPointer(dis, root, False, BUTTONMASK|PointerMotionMask, GrabModeAsync,
                      GrabModeAsync, None, None, CurrentTime) != GrabSuccess) return;
 
-    if (!d->curr->isfloat && !d->curr->istrans) { d->curr->isfloat = True; tile(d); focus(d->curr, d); }
-
+    Client *t = d->curr;
+    if (!t->isfloat && !t->istrans) { t->isfloat = True; tile(d); focus(t, d); }
+    commit();
+
+    /* nx, ny, nw, nh is where the pointer wants the window, last is when the window last followed */
+    int nx = t->x, ny = t->y, nw = t->w, nh = t->h;
+    Time last = 0;
+#ifdef DEBUG
+    unsigned long motions = 0, configures = 0;
+    Time first = 0, newest = 0, lag = 0;
+#endif
     do {
-        XMaskEvent(dis, BUTTONMASK|PointerMotionMask|SubstructureRedirectMask, &ev);
+        Bool due = False;
+        if (t->x == nx && t->y == ny && t->w == nw && t->h == nh)
+            XMaskEvent(dis, BUTTONMASK|PointerMotionMask|SubstructureRedirectMask, &ev);
+        else if (!XCheckMaskEvent(dis, BUTTONMASK|PointerMotionMask|SubstructureRedirectMask, &ev)) {
+            due = poll(&(struct pollfd){ ConnectionNumber(dis), POLLIN, 0 }, 1, 1000/REFRESH_RATE) <= 0;
+            ev.type = 0;
+        }
+
         if (ev.type == MotionNotify) {
-            xw = (arg->i == MOVE ? wa.x:wa.width)  + ev.xmotion.x - rx;
-            yh = (arg->i == MOVE ? wa.y:wa.height) + ev.xmotion.y - ry;
-            if (arg->i == RESIZE) XResizeWindow(dis, d->curr->win,
-                    xw > MINWSZ ? xw:wa.width, yh > MINWSZ ? yh:wa.height);
-            else if (arg->i == MOVE) XMoveWindow(dis, d->curr->win, xw, yh);
-        } else if (ev.type == ConfigureRequest || ev.type == MapRequest) events[ev.type](&ev);
+#ifdef DEBUG
+            if (!first) first = ev.xmotion.time;
+            for (motions++; XCheckTypedEvent(dis, MotionNotify, &ev); motions++);
+            newest = ev.xmotion.time;
+#else
+            while (XCheckTypedEvent(dis, MotionNotify, &ev));
+#endif
+            xw = (arg->i == MOVE ? ox:ow) + ev.xmotion.x - rx;
+            yh = (arg->i == MOVE ? oy:oh) + ev.xmotion.y - ry;
+            if (arg->i == RESIZE) { nw = xw > MINWSZ ? xw:ow; nh = yh > MINWSZ ? yh:oh; }
+            else if (arg->i == MOVE) { nx = xw; ny = yh; }
+            due = ev.xmotion.time - last >= 1000/REFRESH_RATE;
+        } else if (ev.type == ConfigureRequest || ev.type == MapRequest) { events[ev.type](&ev); commit(); }
+
+        if (!due && ev.type != ButtonRelease) continue;
+        last = ev.type == MotionNotify ? ev.xmotion.time:0;
+#ifdef DEBUG
+        Time now = ev.type == MotionNotify ? ev.xmotion.time:ev.type ? ev.xbutton.time:newest + 1000/REFRESH_RATE;
+        if (first && now - first > lag) lag = now - first;
+        if (t->x != nx || t->y != ny || t->w != nw || t->h != nh) configures++;
+        first = 0;
+#endif
+        resize(t, nx, ny, nw, nh);
     } while (ev.type != ButtonRelease);
 
     XUngrabPointer(dis, CurrentTime);
+#ifdef DEBUG
+    fprintf(stderr, "mousemotion: %lu motion events, %lu configure requests, %lums lag at most\n",
+            motions, configures, lag);
+#endif
+
+    for (int k = 0; arg->i == MOVE && t == d->curr && k < nmonitors; k++) {
+        const Monitor *m = &monitors[k];
+        int x = t->x + t->w/2, y = t->y + t->h/2, i = m->desk;
+        if (i == currdeskidx || x < m->x || y < m->y || x >= m->x + m->w || y >= m->y + m->h + PANEL_HEIGHT) continue;
+        x = t->x; y = t->y;
+        client_to_desktop(&(Arg){.i = i});
+        resize(t, x, y, t->w, t->h); /* where it was dropped, not at its place relative to the old monitor */
+        change_desktop(&(Arg){.i = i});
+        break;
+    }
 }
 
+#ifdef METRICS
+/**
+ * report the metrics recorded for each event handler, one line each,
+ * to the given control socket connection, or to stderr if it is -1
+ *
+ * most requests are made when the changes of a batch are applied, after
+ * the handlers, so commit has a line of its own. the commits a handler
+ * makes itself, as mousemotion does, count for both.
+ *
+ * a line has the handler's name, the number of events it handled,
+ * the requests and round trips it made, the 50th and 99th percentile
+ * of its latency, and its latency histogram, all tab separated.
+ * latencies are in microseconds; bucket b of the histogram holds the
+ * latencies under 2^b and not under 2^(b-1), and a percentile is the
+ * upper bound of the bucket it falls in
+ */
+void metrics(int i) {
+    for (int t = 0; t <= LASTEvent; t++) if (stats[t].count) {
+        char s[512];
+        unsigned long p50 = 0, p99 = 0, sum = 0;
+        int n = 0, top = LENGTH(stats[t].usec);
+        while (!stats[t].usec[top - 1]) top--;
+        for (int b = 0; b < top; b++) {
+            unsigned long prev = sum, half = (stats[t].count + 1)/2, most = stats[t].count - stats[t].count/100;
+            sum += stats[t].usec[b];
+            if (prev < half && sum >= half) p50 = (1UL << b) - 1;
+            if (prev < most && sum >= most) p99 = (1UL << b) - 1;
+        }
+        n = snprintf(s, sizeof s, "%s\t%lu\t%lu\t%lu\t%lu\t%lu\t", t == LASTEvent ? "commit":evnames[t] ? evnames[t]:"other",
+                     stats[t].count, stats[t].req, stats[t].rt, p50, p99);
+        for (int b = 0; b < top && n < (int)sizeof s; b++) n += snprintf(s + n, sizeof s - n, b ? ",%lu":"%lu", stats[t].usec[b]);
+        if (n < (int)sizeof s - 1) { s[n++] = '\n'; s[n] = '\0'; } else s[sizeof s - 2] = '\n';
+        if (i < 0) fputs(s, stderr); else sendline(i, s);
+    }
+}
+
+#endif
+
 /**
  * monocle aka max aka fullscreen mode/layout
  * each window should cover all the available screen space
  */
-void monocle(int x, int y, int w, int h, const Desktop *d) {
-    for (Client *c = d->head; c; c = c->next) if (!ISFFT(c)) XMoveResizeWindow(dis, c->win, x, y, w, h);
+void monocle(__attribute__((unused)) int mode, int n, __attribute__((unused)) int masz,
+             __attribute__((unused)) int sasz, XRectangle a, __attribute__((unused)) int bw, XRectangle *r) {
+    for (int i = 0; i < n; i++) r[i] = RECT(a.x, a.y, a.width, a.height);
 }
 
 /**
  * swap positions of current and next from current clients
+ * if current is the last client, it becomes the head
  */
 void move_down(void) {
     Desktop *d = &desktops[currdeskidx];
-    if (!d->curr || !d->head->next) return;
-    /* p is previous, c is current, n is next, if current is head n is last */
-    Client *p = prevclient(d->curr, d), *n = (d->curr->next) ? d->curr->next:d->head;
-    /*
-     * if c is head, swapping with n should update head to n
-     * [c]->[n]->..  ==>  [n]->[c]->..
-     *  ^head              ^head
-     *
-     * else there is a previous client and p->next should be what's after c
-     * ..->[p]->[c]->[n]->..  ==>  ..->[p]->[n]->[c]->..
-     */
-    if (d->curr == d->head) d->head = n; else p->next = d->curr->next;
-    /*
-     * if c is the last client, c will be the current head
-     * [n]->..->[p]->[c]->NULL  ==>  [c]->[n]->..->[p]->NULL
-     *  ^head                         ^head
-     * else c will take the place of n, so c-next will be n->next
-     * ..->[p]->[c]->[n]->..  ==>  ..->[p]->[n]->[c]->..
-     */
-    d->curr->next = (d->curr->next) ? n->next:n;
-    /*
-     * if c was swapped with n then they now point to the same ->next. n->next should be c
-     * ..->[p]->[c]->[n]->..  ==>  ..->[p]->[n]->..  ==>  ..->[p]->[n]->[c]->..
-     *                                        [c]-^
-     *
-     * else c is the last client and n is head,
-     * so c will be move to be head, no need to update n->next
-     * [n]->..->[p]->[c]->NULL  ==>  [c]->[n]->..->[p]->NULL
-     *  ^head                         ^head
-     */
-    if (d->curr->next == n->next) n->next = d->curr; else d->head = d->curr;
+    if (!d->curr || d->count < 2) return;
+    Client *c = d->curr;
+    if (c->pos + 1 < d->count) (d->list[c->pos] = d->list[c->pos + 1])->pos--, d->list[++c->pos] = c;
+    else { detach(c, d); attach(c, d, 0); }
     if (!d->curr->isfloat && !d->curr->istrans) tile(d);
 }
 
 /**
  * swap positions of current and previous from current clients
+ * if current is the head, it becomes the last client
  */
 void move_up(void) {
     Desktop *d = &desktops[currdeskidx];
-    if (!d->curr || !d->head->next) return;
-    /* p is previous from current or last if current is head */
-    Client *pp = NULL, *p = prevclient(d->curr, d);
-    /* pp is previous from p, or null if current is head and thus p is last */
-    if (p->next) for (pp = d->head; pp && pp->next != p; pp = pp->next);
-    /*
-     * if p has a previous client then the next client should be current (current is c)
-     * ..->[pp]->[p]->[c]->..  ==>  ..->[pp]->[c]->[p]->..
-     *
-     * if p doesn't have a previous client, then p might be head, so head must change to c
-     * [p]->[c]->..  ==>  [c]->[p]->..
-     *  ^head              ^head
-     * if p is not head, then c is head (and p is last), so the new head is next of c
-     * [c]->[n]->..->[p]->NULL  ==>  [n]->..->[p]->[c]->NULL
-     *  ^head         ^last           ^head         ^last
-     */
-    if (pp) pp->next = d->curr; else d->head = (d->curr == d->head) ? d->curr->next:d->curr;
-    /*
-     * next of p should be next of c
-     * ..->[pp]->[p]->[c]->[n]->..  ==>  ..->[pp]->[c]->[p]->[n]->..
-     * except if c was head (now c->next is head), so next of p should be c
-     * [c]->[n]->..->[p]->NULL  ==>  [n]->..->[p]->[c]->NULL
-     *  ^head         ^last           ^head         ^last
-     */
-    p->next = (d->curr->next == d->head) ? d->curr:d->curr->next;
-    /*
-     * next of c should be p
-     * ..->[pp]->[p]->[c]->[n]->..  ==>  ..->[pp]->[c]->[p]->[n]->..
-     * except if c was head (now c->next is head), so c is must be last
-     * [c]->[n]->..->[p]->NULL  ==>  [n]->..->[p]->[c]->NULL
-     *  ^head         ^last           ^head         ^last
-     */
-    d->curr->next = (d->curr->next == d->head) ? NULL:p;
+    if (!d->curr || d->count < 2) return;
+    Client *c = d->curr;
+    if (c->pos > 0) (d->list[c->pos] = d->list[c->pos - 1])->pos++, d->list[--c->pos] = c;
+    else { detach(c, d); attach(c, d, d->count); }
     if (!d->curr->isfloat && !d->curr->istrans) tile(d);
 }
 
 /**
  * move and resize a window with the keyboard
+ * relative to the geometry known to the wm (see resize)
  */
 void moveresize(const Arg *arg) {
     Desktop *d = &desktops[currdeskidx];
-    XWindowAttributes wa;
-    if (!d->curr || !XGetWindowAttributes(dis, d->curr->win, &wa)) return;
+    if (!d->curr) return;
     if (!d->curr->isfloat && !d->curr->istrans) { d->curr->isfloat = True; tile(d); focus(d->curr, d); }
-    XMoveResizeWindow(dis, d->curr->win, wa.x + ((int *)arg->v)[0], wa.y + ((int *)arg->v)[1],
-                                wa.width + ((int *)arg->v)[2], wa.height + ((int *)arg->v)[3]);
+    resize(d->curr, d->curr->x + ((int *)arg->v)[0], d->curr->y + ((int *)arg->v)[1],
+                    d->curr->w + ((int *)arg->v)[2], d->curr->h + ((int *)arg->v)[3]);
 }
 
 /**
@@ -884,17 +1836,151 @@ void moveresize(const Arg *arg) {
  */
 void next_win(void) {
     Desktop *d = &desktops[currdeskidx];
-    if (d->curr && d->head->next) focus(d->curr->next ? d->curr->next:d->head, d);
+    if (d->curr && d->count > 1) focus(nextclient(d->curr, d), d);
+}
+
+/**
+ * get the next client from the given, or the head if it is the last
+ * if no such client, return NULL
+ */
+Client* nextclient(Client *c, Desktop *d) {
+    return c && d->count > 1 ? d->list[(c->pos + 1) % d->count]:NULL;
+}
+
+/**
+ * cut the next word out of the string, moving the string past it
+ * return NULL at the end of the string
+ */
+char* nexttoken(char **s) {
+    char *t = *s + strspn(*s, " \t\r");
+    if (!*t) return NULL;
+    *s = t + strcspn(t, " \t\r");
+    if (**s) *(*s)++ = '\0';
+    return t;
 }
 
 /**
- * get the previous client from the given
+ * get the previous client from the given, or the last if it is the head
  * if no such client, return NULL
  */
 Client* prevclient(Client *c, Desktop *d) {
-    Client *p = NULL;
-    if (c && d->head && d->head->next) for (p = d->head; p->next && p->next != c; p = p->next);
-    return p;
+    return c && d->count > 1 ? d->list[(c->pos + d->count - 1) % d->count]:NULL;
+}
+
+/**
+ * find out what is needed to manage each of the given windows
+ *
+ * when built with xcb support, the requests for all the windows are
+ * sent at once through the connection xlib shares with xcb, and then
+ * their replies are collected, so the round trips to the server do
+ * not add up. otherwise each property is requested and waited on
+ * in turn through xlib.
+ */
+void probe(const Window *w, Probe *p, int n) {
+#ifdef XCB
+    xcb_connection_t *xc = XGetXCBConnection(dis);
+    xcb_get_window_attributes_cookie_t ac[n];
+    xcb_get_geometry_cookie_t gc[n];
+    xcb_get_property_cookie_t cc[n], tc[n], sc[n], pc[n], dc[n], nc[n], mc[n], rc[n], yc[n];
+    const Bool fetchtitle = EXTENDED_INFO || conf.fetchtitle;
+
+    for (int i = 0; i < n; i++) {
+        ac[i] = xcb_get_window_attributes(xc, w[i]);
+        gc[i] = xcb_get_geometry(xc, w[i]);
+        cc[i] = xcb_get_property(xc, 0, w[i], XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, sizeof p->class/2);
+        tc[i] = xcb_get_property(xc, 0, w[i], XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+        sc[i] = xcb_get_property(xc, 0, w[i], netatoms[NET_WM_STATE], XCB_ATOM_ATOM, 0, 32);
+        dc[i] = xcb_get_property(xc, 0, w[i], netatoms[NET_WM_DESKTOP], XCB_ATOM_CARDINAL, 0, 1);
+        if (fetchtitle) {
+            nc[i] = xcb_get_property(xc, 0, w[i], netatoms[NET_WM_NAME], XCB_GET_PROPERTY_TYPE_ANY, 0, sizeof p->title/4);
+            mc[i] = xcb_get_property(xc, 0, w[i], XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, sizeof p->title/4);
+        }
+        pc[i] = xcb_get_property(xc, 0, w[i], wmatoms[WM_PROTOCOLS], XCB_ATOM_ATOM, 0, 32);
+        if (conf.fetchrole) rc[i] = xcb_get_property(xc, 0, w[i], wmatoms[WM_WINDOW_ROLE], XCB_ATOM_STRING, 0, sizeof p->role/4);
+        if (conf.fetchtype) yc[i] = xcb_get_property(xc, 0, w[i], netatoms[NET_WM_WINDOW_TYPE], XCB_ATOM_ATOM, 0, 1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        xcb_get_window_attributes_reply_t *a = xcb_get_window_attributes_reply(xc, ac[i], NULL);
+        xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(xc, gc[i], NULL);
+        xcb_get_property_reply_t *cr = xcb_get_property_reply(xc, cc[i], NULL),
+                                 *tr = xcb_get_property_reply(xc, tc[i], NULL),
+                                 *sr = xcb_get_property_reply(xc, sc[i], NULL),
+                                 *pr = xcb_get_property_reply(xc, pc[i], NULL),
+                                 *dr = xcb_get_property_reply(xc, dc[i], NULL),
+                                 *nr = fetchtitle ? xcb_get_property_reply(xc, nc[i], NULL):NULL,
+                                 *mr = fetchtitle ? xcb_get_property_reply(xc, mc[i], NULL):NULL,
+                                 *rr = conf.fetchrole ? xcb_get_property_reply(xc, rc[i], NULL):NULL,
+                                 *yr = conf.fetchtype ? xcb_get_property_reply(xc, yc[i], NULL):NULL;
+
+        if ((p[i] = (Probe){ .valid = a && g, .desk = -1 }).valid) {
+            p[i].override = a->override_redirect;
+            p[i].viewable = a->map_state == XCB_MAP_STATE_VIEWABLE;
+            p[i].x = g->x; p[i].y = g->y; p[i].w = g->width; p[i].h = g->height; p[i].bw = g->border_width;
+        }
+        if (cr && xcb_get_property_value_length(cr) > 0) { /* WM_CLASS is "instance\0class\0" */
+            const char *v = xcb_get_property_value(cr), *z; int l = xcb_get_property_value_length(cr);
+            int k = (z = memchr(v, '\0', l)) ? z - v : l;
+            snprintf(p[i].instance, sizeof p[i].instance, "%.*s", k, v);
+            if ((v += k + 1, l -= k + 1) > 0)
+                snprintf(p[i].class, sizeof p[i].class, "%.*s", (z = memchr(v, '\0', l)) ? (int)(z - v) : l, v);
+        }
+        p[i].istrans = tr && tr->type == XCB_ATOM_WINDOW && xcb_get_property_value_length(tr) > 0;
+        for (int k = 0; sr && k < xcb_get_property_value_length(sr)/4; k++)
+            p[i].isfull |= ((xcb_atom_t *)xcb_get_property_value(sr))[k] == netatoms[NET_FULLSCREEN];
+        for (int k = 0; pr && k < xcb_get_property_value_length(pr)/4; k++)
+            p[i].candelete |= ((xcb_atom_t *)xcb_get_property_value(pr))[k] == wmatoms[WM_DELETE_WINDOW];
+        if (dr && xcb_get_property_value_length(dr) == 4) p[i].desk = *(int32_t *)xcb_get_property_value(dr);
+        xcb_get_property_reply_t *tt = nr && nr->format == 8 && xcb_get_property_value_length(nr) ? nr:mr;
+        if (tt && tt->format == 8) snprintf(p[i].title, sizeof p[i].title, "%.*s",
+                                            xcb_get_property_value_length(tt), (char *)xcb_get_property_value(tt));
+        if (rr && rr->format == 8) snprintf(p[i].role, sizeof p[i].role, "%.*s",
+                                            xcb_get_property_value_length(rr), (char *)xcb_get_property_value(rr));
+        if (yr && xcb_get_property_value_length(yr) == 4) p[i].type = *(xcb_atom_t *)xcb_get_property_value(yr);
+
+        free(a); free(g); free(cr); free(tr); free(sr); free(pr); free(dr); free(nr); free(mr); free(rr); free(yr);
+    }
+#else
+    for (int i = 0; i < n; i++) {
+        XWindowAttributes wa; XClassHint ch = {0, 0}; Window t;
+        int f; unsigned long l, r; unsigned char *state = NULL; Atom a;
+
+        if (!(p[i] = (Probe){ .valid = XGetWindowAttributes(dis, w[i], &wa), .desk = -1 }).valid) continue;
+        p[i].override = wa.override_redirect;
+        p[i].viewable = wa.map_state == IsViewable;
+        p[i].x = wa.x; p[i].y = wa.y; p[i].w = wa.width; p[i].h = wa.height; p[i].bw = wa.border_width;
+
+        if (XGetClassHint(dis, w[i], &ch)) {
+            snprintf(p[i].class, sizeof p[i].class, "%s", ch.res_class ? ch.res_class:"");
+            snprintf(p[i].instance, sizeof p[i].instance, "%s", ch.res_name ? ch.res_name:"");
+        }
+        if (ch.res_class) XFree(ch.res_class);
+        if (ch.res_name) XFree(ch.res_name);
+
+        p[i].istrans = XGetTransientForHint(dis, w[i], &t);
+        if (XGetWindowProperty(dis, w[i], netatoms[NET_WM_STATE], 0L, 32L, False, XA_ATOM,
+                               &a, &f, &l, &r, &state) == Success && state)
+            for (unsigned long k = 0; k < l; k++) p[i].isfull |= ((Atom *)state)[k] == netatoms[NET_FULLSCREEN];
+        if (state) XFree(state);
+        state = NULL;
+        if (XGetWindowProperty(dis, w[i], netatoms[NET_WM_DESKTOP], 0L, 1L, False, XA_CARDINAL,
+                               &a, &f, &l, &r, &state) == Success && state && l)
+            p[i].desk = *(long *)state;
+        if (state) XFree(state);
+        p[i].candelete = wmdelete(w[i]);
+        if (EXTENDED_INFO || conf.fetchtitle) gettitle(w[i], p[i].title, sizeof p[i].title);
+        state = NULL;
+        if (conf.fetchrole && XGetWindowProperty(dis, w[i], wmatoms[WM_WINDOW_ROLE], 0L, sizeof p[i].role/4, False,
+                         XA_STRING, &a, &f, &l, &r, &state) == Success && state && f == 8)
+            snprintf(p[i].role, sizeof p[i].role, "%.*s", (int)l, (char *)state);
+        if (state) XFree(state);
+        state = NULL;
+        if (conf.fetchtype && XGetWindowProperty(dis, w[i], netatoms[NET_WM_WINDOW_TYPE], 0L, 1L, False, XA_ATOM,
+                                            &a, &f, &l, &r, &state) == Success && state && l)
+            p[i].type = *(Atom *)state;
+        if (state) XFree(state);
+    }
+#endif
 }
 
 /**
@@ -903,21 +1989,29 @@ Client* prevclient(Client *c, Desktop *d) {
  */
 void prev_win(void) {
     Desktop *d = &desktops[currdeskidx];
-    if (d->curr && d->head->next) focus(prevclient(d->curr, d), d);
+    if (d->curr && d->count > 1) focus(prevclient(d->curr, d), d);
 }
 
 /**
  * set unrgent hint for a window
+ * and keep track of whether it accepts WM_DELETE_WINDOW messages
+ * and of its title, when that is output (see desktopinfo)
  */
 void propertynotify(XEvent *e) {
     Desktop *d = NULL; Client *c = NULL;
-    if (e->xproperty.atom != XA_WM_HINTS || !wintoclient(e->xproperty.window, &c, &d)) return;
+    if (!wintoclient(e->xproperty.window, &c, &d)) return;
+    tagwindow(c->win);
+    if (e->xproperty.atom == wmatoms[WM_PROTOCOLS]) c->candelete = wmdelete(c->win);
+    if (EXTENDED_INFO && (e->xproperty.atom == netatoms[NET_WM_NAME] || e->xproperty.atom == XA_WM_NAME))
+        gettitle(c->win, c->title, sizeof c->title);
+    if (e->xproperty.atom != XA_WM_HINTS) return;
 
     XWMHints *wmh = XGetWMHints(dis, c->win);
-    c->isurgn = (c != desktops[currdeskidx].curr && wmh && (wmh->flags & XUrgencyHint));
+    Bool urgent = (c != desktops[currdeskidx].curr && wmh && (wmh->flags & XUrgencyHint));
+    d->urgent += urgent - c->isurgn;
+    c->isurgn = urgent;
 
     if (wmh) XFree(wmh);
-    desktopinfo();
 }
 
 /**
@@ -929,21 +2023,378 @@ void quit(const Arg *arg) {
     running = False;
 }
 
+/**
+ * read what is available from a connection to the control socket
+ * and run each complete line as a command (see runcommand)
+ *
+ * the connection is closed when the other end closes it, in which case
+ * a last line that does not end in a newline is run as well, or when
+ * it sends a line too long to be a command.
+ */
+void readcommands(int i) {
+    char *s = conns[i].buf, *e = NULL;
+    ssize_t n = read(conns[i].fd, s + conns[i].len, sizeof conns[i].buf - 1 - conns[i].len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+
+    if (n > 0) conns[i].len += n;
+    while ((e = memchr(s, '\n', conns[i].len - (s - conns[i].buf)))) { *e = '\0'; runcommand(s, i); s = e + 1; }
+    memmove(conns[i].buf, s, (conns[i].len -= s - conns[i].buf));
+    if (n > 0 && conns[i].len < sizeof conns[i].buf - 1) return;
+
+    if (n == 0 && conns[i].len) { conns[i].buf[conns[i].len] = '\0'; runcommand(conns[i].buf, i); }
+    close(conns[i].fd);
+    conns[i].fd = -1; conns[i].len = 0; conns[i].sub = False;
+}
+
+/**
+ * read the settings, those of config.h overridden by the given file
+ *
+ * the file is read in memory and parsed in place, once. each line is a
+ * setting, empty lines and lines starting with # are skipped:
+ *
+ *   focus   <color>              unfocus <color>
+ *   border_width <pixels>        master_size <fraction>
+ *        a color name or #rrggbb known to the server, a border width from
+ *        0 to 100 pixels and a master size between 0 and 1
+ *   bind <mod+...|None> <keysym> <command> [args]   - a command of the
+ *        control socket, spawn followed by a shell command, or none
+ *        to remove the binding of the combination
+ *   rule <class> <instance> <title> <role> <type> <desktop> <follow> <float>
+ *        with - for what matches any window
+ *
+ * return False, with the settings released, if the file cannot be read or
+ * has errors, each reported with its line so the settings in effect are kept
+ */
+Bool readconfig(Config *c, const char *path) {
+    static const struct { const char *name; unsigned int mask; } modnames[] = {
+        { "None", 0 }, { "Shift", ShiftMask }, { "Control", ControlMask }, { "Mod1", Mod1Mask },
+        { "Mod2", Mod2Mask }, { "Mod3", Mod3Mask }, { "Mod4", Mod4Mask }, { "Mod5", Mod5Mask },
+    };
+    unsigned int lines = 1, line = 0, a = 0;
+    int fd = path ? open(path, O_RDONLY):-1;
+    char *s = NULL, *e = NULL, *t = NULL;
+    size_t size = 0;
+    ssize_t r = 0;
+
+    /* the file is copied, not mapped, so it changing as it is read cannot harm */
+    *c = (Config){ .focus = FOCUS, .unfocus = UNFOCUS, .borderwidth = BORDER_WIDTH, .mastersize = MASTER_SIZE };
+    while (fd >= 0) {
+        if (c->len + 1 >= size && !(c->buf = realloc(c->buf, (size = size ? 2*size:BUFSIZ)))) err(EXIT_FAILURE, "cannot allocate settings");
+        if ((r = read(fd, c->buf + c->len, size - c->len - 1)) > 0) c->len += r;
+        else if (!r || errno != EINTR) break;
+    }
+    if (fd >= 0) close(fd);
+    if (r < 0) {
+        warn("cannot read %s", path);
+        freeconfig(c);
+        return False;
+    }
+    if (c->buf) c->buf[c->len] = '\0';
+    for (size_t i = 0; i < c->len; i++) lines += c->buf[i] == '\n';
+    if (!(c->keys = calloc(LENGTH(keys) + lines, sizeof(Key))) || !(c->rules = calloc(LENGTH(rules) + lines, sizeof(AppRule)))
+        || !(c->args = calloc(lines, sizeof *c->args))) err(EXIT_FAILURE, "cannot allocate settings");
+    memcpy(c->keys, keys, sizeof keys);
+    c->nkeys = LENGTH(keys);
+
+    for (s = c->buf; s && s < c->buf + c->len; s = e + 1) {
+        line++;
+        if ((e = memchr(s, '\n', c->buf + c->len - s))) *e = '\0'; else e = c->buf + c->len;
+        if (!(t = nexttoken(&s)) || *t == '#') continue;
+        const char *why = "bad setting", *what = t;
+        Bool ok = False;
+
+        if (!strcmp(t, "focus") || !strcmp(t, "unfocus")) {
+            char *v = nexttoken(&s);
+            XColor color;
+            if ((ok = v && XParseColor(dis, DefaultColormap(dis, DefaultScreen(dis)), v, &color)))
+                *(*t == 'f' ? &c->focus:&c->unfocus) = v;
+            else if (v) { why = "unknown color"; what = v; }
+        } else if (!strcmp(t, "border_width")) {
+            char *v = nexttoken(&s), *end = v;
+            long n = v ? strtol(v, &end, 10):0;
+            if ((ok = v && !*end && n >= 0 && n <= 100)) c->borderwidth = n;
+            else if (v) { why = "border width not from 0 to 100 pixels"; what = v; }
+        } else if (!strcmp(t, "master_size")) {
+            char *v = nexttoken(&s), *end = v;
+            double n = v ? strtod(v, &end):0;
+            if ((ok = v && !*end && n > 0 && n < 1)) c->mastersize = n;
+            else if (v) { why = "master size not between 0 and 1"; what = v; }
+        } else if (!strcmp(t, "bind")) {
+            char *mod = nexttoken(&s), *key = nexttoken(&s), *name = nexttoken(&s), *p = NULL;
+            unsigned int mask = 0, k = 0, m = 0;
+            int n = 0;
+            void (*func)(const Arg *) = NULL;
+            KeySym sym = key ? XStringToKeysym(key):NoSymbol;
+            for (p = (ok = name && sym != NoSymbol) ? strtok(mod, "+"):NULL; p; p = strtok(NULL, "+")) {
+                for (m = 0; m < LENGTH(modnames) && strcmp(p, modnames[m].name); m++);
+                if (m < LENGTH(modnames)) mask |= modnames[m].mask; else ok = False;
+            }
+            if (ok && !strcmp(name, "spawn")) {
+                s += strspn(s, " \t\r");
+                memcpy(c->args[a].com, (const char *[]){ "/bin/sh", "-c", s, NULL }, sizeof c->args[a].com);
+                func = spawn;
+                ok = *s != '\0';
+            } else if (ok && strcmp(name, "none")) {
+                char *bad = NULL;
+                for (k = 0; k < LENGTH(commands) && strcmp(name, commands[k].name); k++);
+                while (n < 4 && (p = nexttoken(&s)))
+                    if (k < LENGTH(commands) && !cmdarg(&commands[k], p, &c->args[a].v[n++]) && !bad) bad = p;
+                if ((ok = k < LENGTH(commands) && n == commands[k].args && !bad)) func = commands[k].func;
+                else if (bad && n == commands[k].args) { why = "argument not a number in range"; what = bad; }
+            }
+            if (ok) {
+                Key b = { mask, sym, func, func == spawn ? (Arg){.com = c->args[a].com}
+                                        : n == 1 ? (Arg){.i = c->args[a].v[0]}:(Arg){.v = c->args[a].v} };
+                for (k = 0; k < c->nkeys && (c->keys[k].mod != mask || c->keys[k].keysym != sym); k++);
+                if (!func && k < c->nkeys) memmove(&c->keys[k], &c->keys[k + 1], (--c->nkeys - k) * sizeof b);
+                else if (func) memcpy(&c->keys[k], &b, sizeof b);
+                if (func && k == c->nkeys) c->nkeys++;
+                a++;
+            }
+        } else if (!strcmp(t, "rule")) {
+            char *v[8];
+            int n = 0;
+            while (n < 8 && (v[n] = nexttoken(&s))) n++;
+            if ((ok = n == 8)) {
+                for (n = 0; n < 5; n++) if (!strcmp(v[n], "-")) v[n] = NULL;
+                AppRule r = { v[0], v[1], v[2], v[3], v[4], atoi(v[5]), !strcmp(v[6], "1") || !strcmp(v[6], "True"),
+                              !strcmp(v[7], "1") || !strcmp(v[7], "True") };
+                memcpy(&c->rules[c->nrules++], &r, sizeof r);
+            }
+        }
+        if (!ok) {
+            warnx("%s:%u: %s: %s", path, line, why, what);
+            freeconfig(c);
+            return False;
+        }
+    }
+    memcpy(c->rules + c->nrules, rules, sizeof rules);
+    c->nrules += LENGTH(rules);
+    if (compilerules(c)) return True;
+    freeconfig(c);
+    return False;
+}
+
+#ifdef INOTIFY
+/**
+ * read what happened to the config file, and load the settings again
+ * if it was written, or replaced or put in place as editors save files
+ *
+ * the events of a watch since replaced are left out, and while the
+ * directory is watched, those of the other files in it.
+ */
+void readwatch(void) {
+    union { struct inotify_event ev; char buf[4096]; } u;
+    const char *base = strrchr(confpath, '/') + 1;
+    Bool changed = False;
+    ssize_t len = 0;
+    while ((len = read(watch, u.buf, sizeof u.buf)) > 0)
+        for (char *p = u.buf; p < u.buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            const struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->wd != watched || (ev->len && strcmp(ev->name, base))) continue;
+            if (ev->len || (ev->mask & (IN_MOVE_SELF|IN_DELETE_SELF|IN_ATTRIB))) changed |= watchconfig();
+            else if (ev->mask & IN_CLOSE_WRITE) changed = True;
+        }
+    if (changed) loadconfig();
+}
+#endif
+
+#ifdef METRICS
+/**
+ * count an event handled by the given type's handler, or a commit for
+ * LASTEvent, with the time it took in microseconds, and the requests
+ * and round trips it made
+ */
+void record(int t, long usec, unsigned long req, unsigned long rt) {
+    int b = 0;
+    while (b < (int)LENGTH(stats[t].usec) - 1 && usec >> b) b++;
+    stats[t].count++;
+    stats[t].req += req;
+    stats[t].rt += rt;
+    stats[t].usec[b]++;
+}
+
+#endif
+/**
+ * 1. restack clients
+ * 2. highlight borders and set active window property
+ * 3. give input focus to the current/active/focused client
+ *
+ * the active window property and the input focus
+ * only follow the current desktop's current client.
+ *
+ * only what changed since the desktop was last refocused is requested.
+ * the border widths are worked out again only when the layout generation
+ * changed, and the border colors only of the client that was shown as
+ * focused and of the current one. when both of those are tiled, and
+ * tiled windows do not overlap other windows, which is the case unless
+ * the mode is MONOCLE or there is a fullscreen window, the stacking
+ * order would change nothing that can be seen and is left as it is.
+ *
+ * otherwise the windows are not restacked all together. each client
+ * remembers its position in the order last applied, and the longest
+ * run of clients that are in the new order as they were in the old one
+ * is left in place. the rest are each moved below the window above
+ * them in the new order, or the topmost above the first of those left
+ * in place, so the fewest windows are moved for the server to redraw.
+ */
+void refocus(Desktop *d) {
+    Client *c = NULL;
+    if (!d->curr) { /* no clients - no active window - nothing to do */
+        if (d == &desktops[currdeskidx]) {
+            XSetInputFocus(dis, root, RevertToPointerRoot, CurrentTime);
+            XDeleteProperty(dis, root, netatoms[NET_ACTIVE]);
+        }
+        d->focused = NULL;
+        return;
+    }
+
+    /*
+     * a window should have borders in any case, except if
+     *  - the window is fullscreen
+     *  - the window is not floating or transient and
+     *      - the mode is MONOCLE or,
+     *      - it is the only window on screen
+     */
+    Bool changed = d->fgen != d->gen;
+    if (changed) for (int i = 0; i < d->count; i++) {
+        c = d->list[i];
+        setborder(c, c->isfull || (!ISFFT(c) && (d->mode == MONOCLE || d->count == 1)) ? 0:conf.borderwidth);
+    }
+    if (d->focused != d->curr) {
+        if (d->focused) {
+            tagwindow(d->focused->win);
+            XSetWindowBorder(dis, d->focused->win, win_unfocus);
+            grabbuttons(d->focused);
+        }
+        tagwindow(d->curr->win);
+        XSetWindowBorder(dis, d->curr->win, win_focus);
+        grabbuttons(d->curr);
+    }
+
+    /* restack clients
+     *
+     * stack order is based on client properties.
+     * from top to bottom:
+     *  - current when floating or transient
+     *  - floating or trancient windows
+     *  - current when tiled
+     *  - current when fullscreen
+     *  - fullscreen windows
+     *  - tiled windows
+     *
+     * num of n:all fl:fullscreen ft:floating/transient windows
+     */
+    int n = d->count, fl = 0, ft = 0;
+    for (int i = 0; i < n; i++) if (ISFFT(d->list[i])) { fl++; if (!d->list[i]->isfull) ft++; }
+    if (changed || !d->focused || d->mode == MONOCLE || fl != ft || ISFFT(d->curr) || ISFFT(d->focused)) {
+        Client *s[n];
+        int tail[n], link[n], len = 0, top = n;
+        Bool keep[n];
+
+        s[(d->curr->isfloat || d->curr->istrans) ? 0:ft] = d->curr;
+        fl += !ISFFT(d->curr) ? 1:0;
+        for (int i = 0; i < d->count; i++) if ((c = d->list[i]) != d->curr) s[c->isfull ? --fl:ISFFT(c) ? --ft:--n] = c;
+        n = LENGTH(s);
+
+        /* the longest run of known positions increasing in the new order */
+        for (int i = 0; i < n; i++) {
+            keep[i] = False;
+            if (!s[i]->stackpos) continue;
+            int lo = 0, hi = len;
+            while (lo < hi) { int m = (lo + hi)/2; if (s[tail[m]]->stackpos < s[i]->stackpos) lo = m + 1; else hi = m; }
+            link[i] = lo ? tail[lo - 1]:-1;
+            tail[lo] = i;
+            if (lo == len) len++;
+        }
+        for (int i = len ? tail[len - 1]:-1; i >= 0; i = link[i]) keep[top = i] = True;
+
+        if (d == &desktops[currdeskidx]) restacked[0] = NextRequest(dis);
+        for (int i = 0; i < n; i++) {
+            if (!keep[i] && (i || top < n)) {
+                tagwindow(s[i]->win);
+                XConfigureWindow(dis, s[i]->win, CWSibling|CWStackMode, &(XWindowChanges){
+                    .sibling = i ? s[i - 1]->win:s[top]->win, .stack_mode = i ? Below:Above });
+                if (i || s[i]->stackpos) ewmh.restacked = True; /* not a new window kept on top (see manage) */
+            }
+            s[i]->stackpos = i + 1;
+            d->stack[n - 1 - i] = s[i]->win;
+        }
+        d->sorted = True;
+        if (d == &desktops[currdeskidx]) restacked[1] = NextRequest(dis);
+    }
+    d->focused = d->curr;
+    d->fgen = d->gen;
+
+    if (d != &desktops[currdeskidx]) return;
+    XSetInputFocus(dis, d->curr->win, RevertToPointerRoot, CurrentTime);
+    tagwindow(None);
+    XChangeProperty(dis, root, netatoms[NET_ACTIVE], XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char *)&d->curr->win, 1);
+}
+
 /**
  * remove the specified client from the given desktop
  *
  * if c was the previous client, previous must be updated.
  * if c was the current client, current must be updated.
+ * the client is also dropped from the window index, and from the
+ * client list, which is published again at the end of the batch.
  */
 void removeclient(Client *c, Desktop *d) {
     Client **p = NULL;
-    for (p = &d->head; *p && (*p != c); p = &(*p)->next);
-    if (!*p) return; else *p = c->next;
-    if (c == d->prev && !(d->prev = prevclient(d->curr, d))) d->prev = d->head;
-    if (c == d->curr || (d->head && !d->head->next)) focus(d->prev, d);
-    if (!(c->isfloat || c->istrans) || (d->head && !d->head->next)) tile(d);
+    if (c->pos >= d->count || d->list[c->pos] != c) return;
+    detach(c, d);
+    for (p = &wintable[WINSLOT(c->win)]; *p && (*p != c); p = &(*p)->hnext);
+    if (*p) *p = c->hnext;
+    for (int i = 0; i < ewmh.count; i++) if (ewmh.list[i] == c->win) {
+        memmove(ewmh.list + i, ewmh.list + i + 1, (--ewmh.count - i) * sizeof(Window));
+        ewmh.removed = ewmh.restacked = True;
+        break;
+    }
+    if (c == d->prev && !(d->prev = prevclient(d->curr, d))) d->prev = d->count ? d->list[0]:NULL;
+    if (c == d->focused) d->focused = NULL;
+    if (c == d->curr || d->count == 1) focus(d->prev, d);
+    if (!(c->isfloat || c->istrans) || d->count == 1) tile(d);
+    if (c->isurgn) d->urgent--;
     free(c);
-    desktopinfo();
+}
+
+/**
+ * put the client's window in the container of the desktop the client
+ * is attached to. coming from the container of the given desktop it
+ * keeps its place relative to the container, from the root its place
+ *
+ * a mapped window is unmapped and mapped again on the way, the unmap
+ * is counted so that it is not taken for the client's (see unmapnotify)
+ */
+void reparent(Client *c, const Desktop *d, Bool mapped) {
+    const Desktop *n = &desktops[c->desk];
+    if (d) { c->x += n->cx - d->cx; c->y += n->cy - d->cy; }
+    if (mapped) c->unmaps++;
+    tagwindow(c->win);
+    c->serial = NextRequest(dis); /* configure notifications relative to the old parent are stale */
+    XReparentWindow(dis, c->win, n->cont, c->x - n->cx, c->y - n->cy);
+    if (d && (n->cx != d->cx || n->cy != d->cy)) sendconfigure(c);
+}
+
+/**
+ * move and resize the client's window to the given geometry
+ *
+ * the geometry the window was last given is kept in the client, so
+ * requests that would change nothing are not sent, and the clients
+ * are not asked to redraw when their desktop is tiled again.
+ * the geometry is relative to the root, the window's to its container,
+ * so a window that moves is told where it is on the root (see sendconfigure)
+ */
+void resize(Client *c, int x, int y, int w, int h) {
+    if (c->x == x && c->y == y && c->w == w && c->h == h) return;
+    const Desktop *d = &desktops[c->desk];
+    Bool moved = c->x != x || c->y != y;
+    tagwindow(c->win);
+    c->serial = NextRequest(dis);
+    XMoveResizeWindow(dis, c->win, (c->x = x) - d->cx, (c->y = y) - d->cy, (c->w = w), (c->h = h));
+    if (moved) sendconfigure(c);
 }
 
 /**
@@ -953,8 +2404,9 @@ void removeclient(Client *c, Desktop *d) {
  */
 void resize_master(const Arg *arg) {
     Desktop *d = &desktops[currdeskidx];
-    int msz = (d->mode == BSTACK ? wh:ww) * MASTER_SIZE + (d->masz += arg->i);
-    if (msz >= MINWSZ && (d->mode == BSTACK ? wh:ww) - msz >= MINWSZ) tile(d);
+    const Monitor *m = deskmon(currdeskidx);
+    int msz = (d->mode == BSTACK ? m->h:m->w) * conf.mastersize + (d->masz += arg->i);
+    if (msz >= MINWSZ && (d->mode == BSTACK ? m->h:m->w) - msz >= MINWSZ) tile(d);
     else d->masz -= arg->i; /* reset master area size */
 }
 
@@ -970,25 +2422,318 @@ void resize_stack(const Arg *arg) {
  * jump and focus the next or previous desktop
  */
 void rotate(const Arg *arg) {
-    change_desktop(&(Arg){.i = (DESKTOPS + currdeskidx + arg->i) % DESKTOPS});
+    change_desktop(&(Arg){.i = (ndesktops + currdeskidx + arg->i % ndesktops) % ndesktops});
 }
 
 /**
- * jump and focus the next non-empty desktop
+ * jump and focus the next or previous non-empty desktop
+ * only the sign of the argument is taken into account
  */
 void rotate_filled(const Arg *arg) {
-    int n = arg->i;
-    while (n < DESKTOPS && !desktops[(DESKTOPS + currdeskidx + n) % DESKTOPS].head) (n += arg->i);
-    change_desktop(&(Arg){.i = (DESKTOPS + currdeskidx + n) % DESKTOPS});
+    int s = arg->i < 0 ? -1:1, n = ndesktops;
+    for (int i = 0; i < nfilled; i++) {
+        int k = ((filled[i] - currdeskidx) * s + ndesktops - 1) % ndesktops + 1;
+        if (k < n) n = k;
+    }
+    change_desktop(&(Arg){.i = (currdeskidx + s*n + ndesktops) % ndesktops});
 }
 
 /**
  * main event loop
- * on receival of an event call the appropriate handler
+ *
+ * wait for an event, then drain every event that is already pending
+ * into a batch, merging events that make older ones redundant (see
+ * coalesce). input events are handled first, so that the user acts
+ * on the state seen when pressing, and then the rest in order of
+ * arrival. finally the accumulated changes are applied once (see
+ * commit) and the loop starts over.
+ *
+ * the batch ends early with the press of a button binding, so that
+ * the events that follow, such as the release of the button, are left
+ * in the queue for the function of the binding to read (see bound).
+ *
+ * while waiting for events, the rest of a status line that could not
+ * be written out is written as soon as the reader is ready for it,
+ * and the commands that arrive on the control socket are handled.
  */
 void run(void) {
-    XEvent ev;
-    while(running && !XNextEvent(dis, &ev)) if (events[ev.type]) events[ev.type](&ev);
+    static XEvent queue[256];
+    while (running) {
+        int n = 0;
+#ifdef METRICS
+        if (dumpstats) { dumpstats = 0; metrics(-1); }
+#endif
+        if (!XPending(dis)) {
+            struct pollfd fds[4 + LENGTH(conns)] = {
+                { ConnectionNumber(dis), POLLIN, 0 },
+                { !info.closed && (info.queued || info.off < info.len) ? STDOUT_FILENO:-1, POLLOUT, 0 },
+                { sock, POLLIN, 0 },
+                { watch, POLLIN, 0 },
+            };
+            for (unsigned int i = 0; i < LENGTH(conns); i++) fds[4 + i] = (struct pollfd){ conns[i].fd, POLLIN, 0 };
+            if (poll(fds, LENGTH(fds), -1) <= 0) continue;
+#ifdef BENCH
+            benchstart();
+#endif
+
+            if (fds[1].revents) flushinfo();
+            if (fds[2].revents) {
+                int fd = accept(sock, NULL, NULL), i = 0;
+                while (i < (int)LENGTH(conns) && conns[i].fd >= 0) i++;
+                if (fd >= 0 && i == LENGTH(conns)) close(fd);
+                else if (fd >= 0) {
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    conns[i].fd = fd;
+                }
+            }
+#ifdef INOTIFY
+            if (fds[3].revents) readwatch();
+#endif
+            /* all the commands read are applied at once, as a batch of events is */
+            for (unsigned int i = 0; running && i < LENGTH(conns); i++) if (fds[4 + i].revents) readcommands(i);
+            tagwindow(None);
+            commit();
+#ifdef BENCH
+            benchend();
+#endif
+            if (!fds[0].revents) continue;
+        }
+        XNextEvent(dis, &queue[n++]);
+#ifdef BENCH
+        benchstart();
+#endif
+        while (n < (int)LENGTH(queue) && !bound(&queue[n - 1]) && XPending(dis)) { XNextEvent(dis, &queue[n]); coalesce(queue, n++); }
+
+        for (int input = 1; input >= 0; input--) for (int i = 0; running && i < n; i++) {
+            int t = queue[i].type;
+            void (*handler)(XEvent *e) = t < LASTEvent ? events[t]:NULL;
+#ifdef RANDR
+            if (t == rrevbase + RRScreenChangeNotify) handler = screenchange;
+#endif
+            if (input != (t == KeyPress || t == KeyRelease || t == ButtonPress
+                       || t == ButtonRelease || t == MotionNotify) || !handler) continue;
+            tagwindow(None);
+#if defined ROUNDTRIPS || defined METRICS
+            unsigned long rt = roundtrips;
+#endif
+#ifdef METRICS
+            unsigned long req = NextRequest(dis);
+            struct timeval start, end;
+            gettimeofday(&start, NULL);
+#endif
+            handler(&queue[i]);
+#ifdef METRICS
+            gettimeofday(&end, NULL);
+            record(t < LASTEvent ? t:0, (end.tv_sec - start.tv_sec) * 1000000L + end.tv_usec - start.tv_usec,
+                   NextRequest(dis) - req, roundtrips - rt);
+#endif
+#ifdef ROUNDTRIPS
+            if (roundtrips != rt) fprintf(stderr, "roundtrips: event %d: %lu\n", t, roundtrips - rt);
+#endif
+#ifdef DEBUG
+            checkindex();
+#endif
+#ifdef BENCH
+            Bool echo = t == ConfigureNotify || (t == PropertyNotify && queue[i].xproperty.window == root);
+            if (!bench.op || (bench.echo && !echo)) {
+                bench.op = t < LASTEvent && evnames[t] ? evnames[t]:"event";
+                bench.echo = echo;
+            }
+#endif
+        }
+        tagwindow(None);
+        commit();
+#ifdef BENCH
+        benchend();
+#endif
+    }
+}
+
+/**
+ * run a line read from the control socket
+ *
+ * a line is the name of a command followed by its integer arguments,
+ * all separated by blanks, as in "change_desktop 2". the commands are
+ * named after the functions they trigger (see commands).
+ * the "subscribe" command makes the connection receive the status line
+ * (see desktopinfo) now and whenever it changes.
+ * the "reload" command reads the config file again (see loadconfig).
+ * a line that is not a known command, or whose arguments are not numbers
+ * in the range of the command (see cmdarg), is answered with an error.
+ */
+void runcommand(char *s, int i) {
+    char *name = strtok(s, " \t\r"), *a[5], r[sizeof conns[i].buf + 64];
+    int v[4] = {0}, n = 0;
+    if (!name) return;
+    if (!strcmp(name, "subscribe")) { conns[i].sub = True; sendline(i, info.line); return; }
+    if (!strcmp(name, "reload")) { loadconfig(); return; }
+#ifdef METRICS
+    if (!strcmp(name, "metrics")) { metrics(i); return; }
+#endif
+
+    while (n < (int)LENGTH(a) && (a[n] = strtok(NULL, " \t\r"))) n++;
+    for (unsigned int k = 0; k < LENGTH(commands); k++) if (commands[k].args == n && !strcmp(commands[k].name, name)) {
+        for (int j = 0; j < n; j++) if (!cmdarg(&commands[k], a[j], &v[j])) {
+            snprintf(r, sizeof r, "error: %s: argument not a number in range: %s\n", name, a[j]);
+            sendline(i, r);
+            return;
+        }
+#ifdef BENCH
+        if (!bench.op) bench.op = commands[k].name;
+#endif
+        commands[k].func(n == 1 ? &(Arg){.i = v[0]}:&(Arg){.v = v});
+        return;
+    }
+    snprintf(r, sizeof r, "error: %s: unknown command or wrong arguments\n", name);
+    sendline(i, r);
+}
+
+/**
+ * adopt the windows that already exist when the wm starts,
+ * either left behind by a previous instance or created before it.
+ *
+ * all the children of the root window are inspected at once (see probe).
+ * windows that are mapped, or that were placed on a desktop (they may
+ * have been unmapped by the client or another wm), are managed and
+ * put back on their desktop, falling back to the app rules. the
+ * containers of the desktops are override-redirect and left alone.
+ * the layout and focus of every desktop are then applied in one go.
+ */
+void scan(void) {
+    Window root_return, parent_return, *w = NULL;
+    unsigned int n = 0;
+    Probe *p = NULL;
+
+    XGrabServer(dis);
+    if (XQueryTree(dis, root, &root_return, &parent_return, &w, &n) && n) {
+        if (!(p = calloc(n, sizeof(Probe)))) err(EXIT_FAILURE, "cannot allocate window probes");
+        probe(w, p, n);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        if (!p[i].valid || p[i].override || (!p[i].viewable && p[i].desk < 0)) continue;
+        const AppRule *r = matchrule(&p[i]);
+        int k = p[i].desk >= 0 && p[i].desk < ndesktops ? p[i].desk
+              : r && r->desktop >= 0 && r->desktop < ndesktops ? r->desktop:currdeskidx;
+        Desktop *d = &desktops[k];
+        Client *c = manage(w[i], &p[i], d, r && r->floating);
+        if (p[i].isfull) setfullscreen(c, d, True);
+        tagwindow(c->win);
+        XMapWindow(dis, c->win);
+        focus(c, d);
+    }
+    XUngrabServer(dis);
+    if (w) XFree(w);
+    free(p);
+    tagwindow(None);
+    commit();
+}
+
+#ifdef RANDR
+/**
+ * the outputs of the screen changed, read the monitors again
+ */
+void screenchange(XEvent *e) {
+    XRRUpdateConfiguration(e);
+    updategeometry(DisplayWidth(dis, DefaultScreen(dis)), DisplayHeight(dis, DefaultScreen(dis)));
+}
+#endif
+
+/**
+ * tell the client where its window is on the root window, as the
+ * coordinates in the notifications the server sends are relative to
+ * the container, with a synthetic configure notification (ICCCM 4.1.5)
+ */
+void sendconfigure(Client *c) {
+    XConfigureEvent ce = { .type = ConfigureNotify, .display = dis, .event = c->win, .window = c->win,
+        .x = c->x, .y = c->y, .width = c->w, .height = c->h, .border_width = c->bw, .above = None };
+    XSendEvent(dis, c->win, False, StructureNotifyMask, (XEvent *)&ce);
+}
+
+/**
+ * write a line to a connection of the control socket without blocking
+ * a line that does not fit is dropped, and if only a part of it fits
+ * the connection is shut down, as the lines that follow would be garbled.
+ * it is then closed once that is noticed when reading (see readcommands).
+ */
+void sendline(int i, const char *s) {
+    if (!*s) return;
+    ssize_t n = write(conns[i].fd, s, strlen(s));
+    if ((n < 0 && (errno == EAGAIN || errno == EINTR)) || n == (ssize_t)strlen(s)) return;
+    shutdown(conns[i].fd, SHUT_RDWR);
+}
+
+/**
+ * change the number of desktops, there must be one for each monitor
+ *
+ * the monitors showing desktops that are removed show the first
+ * hidden desktops instead. the clients of the desktops that are
+ * removed are moved to the last remaining desktop. desktops only
+ * take up space for their clients once they get some, but each
+ * gets its container window right away (see showdesktop)
+ *
+ * the number and names of the desktops are published on the root
+ */
+void set_desktops(const Arg *arg) {
+    int n = arg->i;
+    if (n < nmonitors || n < 1 || n > 256 || n == ndesktops) return; /* the status line must stay within bounds */
+    for (int i = 0, k = 0; i < nmonitors; i++) if (monitors[i].desk >= n) {
+        while (deskmon(k)) k++;
+        if (monitors[i].desk == currdeskidx) desktops[(currdeskidx = k)].dirty = True;
+        showdesktop(&monitors[i], k);
+    }
+    if (prevdeskidx >= n) prevdeskidx = n - 1;
+
+    for (int i = n; i < ndesktops; i++) {
+        Desktop *d = &desktops[i], *l = &desktops[n - 1];
+        while (d->count) {
+            Client *c = d->list[0];
+            detach(c, d);
+            attach(c, l, l->count);
+            reparent(c, d, True);
+            c->stackpos = 0;
+            ewmh.restacked = True;
+            if (c->isurgn) { d->urgent--; l->urgent++; }
+            tagwindow(c->win);
+            XChangeProperty(dis, c->win, netatoms[NET_WM_DESKTOP], XA_CARDINAL, 32,
+                            PropModeReplace, (unsigned char *)&(long){c->desk}, 1);
+            if (!l->curr) focus(c, l);
+        }
+        tile(l);
+        free(d->list);
+        free(d->stack);
+        XDestroyWindow(dis, d->cont);
+    }
+
+    if (!(desktops = realloc(desktops, n * sizeof(Desktop))) || !(filled = realloc(filled, n * sizeof(int))))
+        err(EXIT_FAILURE, "cannot allocate desktops");
+    for (int i = ndesktops; i < n; i++) {
+        desktops[i] = (Desktop){ .mode = DEFAULT_MODE, .sbar = SHOW_PANEL, .cw = 1, .ch = 1 };
+        desktops[i].cont = XCreateWindow(dis, root, 0, 0, 1, 1, 0, CopyFromParent, InputOutput, CopyFromParent,
+                CWOverrideRedirect|CWBackPixmap|CWEventMask, &(XSetWindowAttributes){ .override_redirect = True,
+                .background_pixmap = ParentRelative, .event_mask = CONTMASK });
+        XLowerWindow(dis, desktops[i].cont); /* below the panel and the windows the wm does not manage */
+    }
+    ndesktops = n;
+    XChangeProperty(dis, root, netatoms[NET_NUMBER_DESKTOPS], XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)&(long){ndesktops}, 1);
+
+    /* the desktops are named by their index, as in the status line */
+    char names[4*n];
+    int len = 0;
+    for (int i = 0; i < n; i++) len += sprintf(names + len, "%d", i) + 1;
+    XChangeProperty(dis, root, netatoms[NET_DESKTOP_NAMES], wmatoms[WM_UTF8_STRING], 8,
+                    PropModeReplace, (unsigned char *)names, len);
+}
+
+/**
+ * set the border width of the client's window, if it is not set already
+ */
+void setborder(Client *c, int bw) {
+    if (c->bw == bw) return;
+    tagwindow(c->win);
+    c->serial = NextRequest(dis);
+    XSetWindowBorderWidth(dis, c->win, (c->bw = bw));
 }
 
 /**
@@ -1006,8 +2751,9 @@ void setfullscreen(Client *c, Desktop *d, Bool fullscrn) {
     if (fullscrn != c->isfull) XChangeProperty(dis, c->win,
             netatoms[NET_WM_STATE], XA_ATOM, 32, PropModeReplace, (unsigned char*)
             ((c->isfull = fullscrn) ? &netatoms[NET_FULLSCREEN]:0), fullscrn);
-    if (fullscrn) XMoveResizeWindow(dis, c->win, 0, 0, ww, wh + PANEL_HEIGHT);
-    XSetWindowBorderWidth(dis, c->win, (c->isfull || !d->head->next ? 0:BORDER_WIDTH));
+    const Monitor *m = deskmon(c->desk) ? deskmon(c->desk):deskmon(currdeskidx);
+    if (fullscrn) resize(c, m->x, m->y, m->w, m->h + PANEL_HEIGHT);
+    setborder(c, (c->isfull || d->count == 1 ? 0:conf.borderwidth));
 }
 
 /**
@@ -1016,45 +2762,18 @@ void setfullscreen(Client *c, Desktop *d, Bool fullscrn) {
 void setup(void) {
     sigchld(0);
 
+    /* a panel going away must not take the wm with it (see flushinfo) */
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) err(EXIT_FAILURE, "cannot ignore SIGPIPE");
+
     /* screen and root window */
     const int screen = DefaultScreen(dis);
     root = RootWindow(dis, screen);
 
-    /* screen width and height */
-    ww = XDisplayWidth(dis,  screen);
-    wh = XDisplayHeight(dis, screen) - PANEL_HEIGHT;
-
-    /* initialize mode and panel visibility for each desktop */
-    for (unsigned int d = 0; d < DESKTOPS; d++)
-        desktops[d] = (Desktop){ .mode = DEFAULT_MODE, .sbar = SHOW_PANEL };
-
-    /* get color for focused and unfocused client borders */
-    win_focus = getcolor(FOCUS, screen);
-    win_unfocus = getcolor(UNFOCUS, screen);
-
-    /* set numlockmask */
-    XModifierKeymap *modmap = XGetModifierMapping(dis);
-    for (int k = 0; k < 8; k++) for (int j = 0; j < modmap->max_keypermod; j++)
-        if (modmap->modifiermap[modmap->max_keypermod*k + j] == XKeysymToKeycode(dis, XK_Num_Lock))
-            numlockmask = (1 << k);
-    XFreeModifiermap(modmap);
-
-    /* set up atoms for dialog/notification windows */
-    wmatoms[WM_PROTOCOLS]     = XInternAtom(dis, "WM_PROTOCOLS",     False);
-    wmatoms[WM_DELETE_WINDOW] = XInternAtom(dis, "WM_DELETE_WINDOW", False);
-    netatoms[NET_SUPPORTED]   = XInternAtom(dis, "_NET_SUPPORTED",   False);
-    netatoms[NET_WM_STATE]    = XInternAtom(dis, "_NET_WM_STATE",    False);
-    netatoms[NET_ACTIVE]      = XInternAtom(dis, "_NET_ACTIVE_WINDOW",       False);
-    netatoms[NET_FULLSCREEN]  = XInternAtom(dis, "_NET_WM_STATE_FULLSCREEN", False);
-
-    /* propagate EWMH support */
-    XChangeProperty(dis, root, netatoms[NET_SUPPORTED], XA_ATOM, 32,
-              PropModeReplace, (unsigned char *)netatoms, NET_COUNT);
-
     /* set the appropriate error handler
      * try an action that will cause an error if another wm is active
      * wait until events are processed to process the error from the above action
-     * if all is good set the generic error handler */
+     * if all is good set the generic error handler.
+     * nothing on the root is touched before, not to upset the other wm */
     XSetErrorHandler(xerrorstart);
     /* set masks for reporting events handled by the wm */
     XSelectInput(dis, root, ROOTMASK);
@@ -1062,8 +2781,107 @@ void setup(void) {
     XSetErrorHandler(xerror);
     XSync(dis, False);
 
-    grabkeys();
-    if (DEFAULT_DESKTOP >= 0 && DEFAULT_DESKTOP < DESKTOPS) change_desktop(&(Arg){.i = DEFAULT_DESKTOP});
+    /* set up atoms for dialog/notification windows, all interned in one round trip */
+    char *names[WM_COUNT + NET_COUNT] = {
+        [WM_PROTOCOLS]               = "WM_PROTOCOLS",
+        [WM_DELETE_WINDOW]           = "WM_DELETE_WINDOW",
+        [WM_UTF8_STRING]             = "UTF8_STRING",
+        [WM_WINDOW_ROLE]             = "WM_WINDOW_ROLE",
+        [WM_COUNT + NET_SUPPORTED]   = "_NET_SUPPORTED",
+        [WM_COUNT + NET_WM_STATE]    = "_NET_WM_STATE",
+        [WM_COUNT + NET_ACTIVE]      = "_NET_ACTIVE_WINDOW",
+        [WM_COUNT + NET_FULLSCREEN]  = "_NET_WM_STATE_FULLSCREEN",
+        [WM_COUNT + NET_WM_DESKTOP]  = "_NET_WM_DESKTOP",
+        [WM_COUNT + NET_WM_NAME]     = "_NET_WM_NAME",
+        [WM_COUNT + NET_NUMBER_DESKTOPS] = "_NET_NUMBER_OF_DESKTOPS",
+        [WM_COUNT + NET_CURRENT_DESKTOP] = "_NET_CURRENT_DESKTOP",
+        [WM_COUNT + NET_DESKTOP_NAMES]   = "_NET_DESKTOP_NAMES",
+        [WM_COUNT + NET_CLIENT_LIST]     = "_NET_CLIENT_LIST",
+        [WM_COUNT + NET_CLIENT_STACKING] = "_NET_CLIENT_LIST_STACKING",
+        [WM_COUNT + NET_WM_WINDOW_TYPE]  = "_NET_WM_WINDOW_TYPE",
+    };
+    Atom atoms[WM_COUNT + NET_COUNT];
+    XInternAtoms(dis, names, LENGTH(names), False, atoms);
+    memcpy(wmatoms, atoms, sizeof wmatoms);
+    memcpy(netatoms, atoms + WM_COUNT, sizeof netatoms);
+
+    /* propagate EWMH support */
+    XChangeProperty(dis, root, netatoms[NET_SUPPORTED], XA_ATOM, 32,
+              PropModeReplace, (unsigned char *)netatoms, NET_COUNT);
+    XDeleteProperty(dis, root, netatoms[NET_CLIENT_LIST]); /* the clients are appended as they are managed */
+
+    /* set up the desktops, keeping the number a previous instance was left with */
+    Atom type; int format; unsigned long n, after; unsigned char *num = NULL;
+    if (XGetWindowProperty(dis, root, netatoms[NET_NUMBER_DESKTOPS], 0L, 1L, False, XA_CARDINAL,
+                &type, &format, &n, &after, &num) == Success && num && n && format == 32)
+        set_desktops(&(Arg){.i = *(long *)num});
+    if (num) XFree(num);
+    if (!ndesktops) set_desktops(&(Arg){.i = DESKTOPS});
+
+    /* the monitors of the screen, each showing a desktop */
+#ifdef RANDR
+    int rrerrbase;
+    if (XRRQueryExtension(dis, &rrevbase, &rrerrbase)) XRRSelectInput(dis, root, RRScreenChangeNotifyMask);
+    else rrevbase = -1;
+#endif
+    updategeometry(XDisplayWidth(dis, screen), XDisplayHeight(dis, screen));
+
+#if defined ROUNDTRIPS || defined METRICS
+    XSetAfterFunction(dis, countroundtrip);
+#endif
+#ifdef METRICS
+    sigusr1(0);
+#endif
+
+    /* listen for commands on the control socket, only the user may connect.
+     * the socket is optional, the wm runs without it if it cannot be set up */
+    for (unsigned int i = 0; i < LENGTH(conns); i++) conns[i].fd = -1;
+    const char *rundir = getenv("XDG_RUNTIME_DIR");
+    if (snprintf(sockaddr.sun_path, sizeof sockaddr.sun_path, SOCKET_PATH, rundir && *rundir ? rundir:"/tmp",
+                 DisplayString(dis)) >= (int)sizeof sockaddr.sun_path) errno = ENAMETOOLONG;
+    else {
+        mode_t mask = umask(S_IRWXG|S_IRWXO);
+        unlink(sockaddr.sun_path);
+        if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 && (fcntl(sock, F_SETFD, FD_CLOEXEC) < 0
+            || bind(sock, (struct sockaddr *)&sockaddr, sizeof sockaddr) < 0 || listen(sock, LENGTH(conns)) < 0)) {
+            int e = errno;
+            close(sock);
+            sock = -1;
+            errno = e;
+        }
+        umask(mask);
+    }
+    if (sock < 0) warn("cannot listen on %s, running without the control socket", sockaddr.sun_path);
+
+    /* the settings, with the border colors and width, the key bindings and the app rules */
+    snprintf(confpath, sizeof confpath, "%s/%s", getenv("HOME") ? getenv("HOME"):".", CONFIG_FILE);
+    loadconfig();
+#ifdef INOTIFY
+    if ((watch = inotify_init()) < 0 || fcntl(watch, F_SETFD, FD_CLOEXEC) < 0
+        || fcntl(watch, F_SETFL, fcntl(watch, F_GETFL) | O_NONBLOCK) < 0) warn("cannot watch %s", confpath);
+    else watchconfig();
+#endif
+    if (DEFAULT_DESKTOP >= 0 && DEFAULT_DESKTOP < ndesktops) change_desktop(&(Arg){.i = DEFAULT_DESKTOP});
+    scan();
+}
+
+/**
+ * show the given desktop on the given monitor instead of the one it shows
+ * either may be -1, for a monitor that is added or removed
+ *
+ * the windows of a desktop stay mapped in its container, so showing
+ * it is mapping the container. to avoid flickering (esp. monocle mode)
+ * the new container is mapped first and then the old one is unmapped
+ *
+ * with more than one monitor the desktop may have been tiled on another,
+ * so it is tiled again
+ */
+void showdesktop(Monitor *m, int i) {
+    Desktop *d = m->desk < 0 ? NULL:&desktops[m->desk], *n = i < 0 ? NULL:&desktops[i];
+    m->desk = i;
+    if (n) { fitcontainer(n, m); XMapWindow(dis, n->cont); }
+    if (d) XUnmapWindow(dis, d->cont);
+    if (n && nmonitors > 1) tile(n);
 }
 
 void sigchld(__attribute__((unused)) int sig) {
@@ -1071,12 +2889,23 @@ void sigchld(__attribute__((unused)) int sig) {
     else err(EXIT_FAILURE, "cannot install SIGCHLD handler");
 }
 
+#ifdef METRICS
+/**
+ * on SIGUSR1 have the metrics reported on stderr, see run
+ */
+void sigusr1(int sig) {
+    if (signal(SIGUSR1, sigusr1) == SIG_ERR) err(EXIT_FAILURE, "cannot install SIGUSR1 handler");
+    dumpstats = sig;
+}
+#endif
+
 /**
  * execute a command
  */
 void spawn(const Arg *arg) {
     if (fork()) return;
     if (dis) close(ConnectionNumber(dis));
+    signal(SIGPIPE, SIG_DFL);
     setsid();
     execvp((char*)arg->com[0], (char**)arg->com);
     err(EXIT_SUCCESS, "execvp %s", (char *)arg->com[0]);
@@ -1086,14 +2915,14 @@ void spawn(const Arg *arg) {
  * tile or common tiling aka v-stack mode/layout
  * bstack or bottom stack aka h-stack mode/layout
  */
-void stack(int x, int y, int w, int h, const Desktop *d) {
-    Client *c = NULL, *t = NULL; Bool b = (d->mode == BSTACK);
-    int n = 0, p = 0, z = (b ? w:h), ma = (b ? h:w) * MASTER_SIZE + d->masz;
+void stack(int mode, int n, int masz, int sasz, XRectangle a, int bw, XRectangle *r) {
+    Bool b = (mode == BSTACK);
+    int x = a.x, y = a.y, w = a.width, h = a.height, p = 0, z = (b ? w:h), ma = masz;
 
-    /* count stack windows and grab first non-floating, non-fullscreen window */
-    for (t = d->head; t; t = t->next) if (!ISFFT(t)) { if (c) ++n; else c = t; }
+    /* the first window is the master, the n others are the stack windows */
+    --n;
 
-    /* if there is only one window (c && !n), it should cover the available screen space
+    /* if there is only one window (!n), it should cover the available screen space
      * if there is only one stack window, then we don't care about growth
      * if more than one stack windows (n > 1) adjustments may be needed.
      *
@@ -1122,40 +2951,68 @@ void stack(int x, int y, int w, int h, const Desktop *d) {
      * should be added to the first stack client (p) so that it satisfies sasz,
      * and also, does not result in gaps created on the bottom of the screen.
      */
-    if (c && !n) XMoveResizeWindow(dis, c->win, x, y, w - 2*BORDER_WIDTH, h - 2*BORDER_WIDTH);
-    if (!c || !n) return; else if (n > 1) { p = (z - d->sasz)%n + d->sasz; z = (z - d->sasz)/n; }
-
-    /* tile the first non-floating, non-fullscreen window to cover the master area */
-    if (b) XMoveResizeWindow(dis, c->win, x, y, w - 2*BORDER_WIDTH, ma - BORDER_WIDTH);
-    else   XMoveResizeWindow(dis, c->win, x, y, ma - BORDER_WIDTH, h - 2*BORDER_WIDTH);
-
-    /* tile the next non-floating, non-fullscreen (and first) stack window adding p */
-    for (c = c->next; c && ISFFT(c); c = c->next);
-    int cw = (b ? h:w) - 2*BORDER_WIDTH - ma, ch = z - BORDER_WIDTH;
-    if (b) XMoveResizeWindow(dis, c->win, x, y += ma, ch - BORDER_WIDTH + p, cw);
-    else   XMoveResizeWindow(dis, c->win, x += ma, y, cw, ch - BORDER_WIDTH + p);
-
-    /* tile the rest of the non-floating, non-fullscreen stack windows */
-    for (b ? (x += ch+p):(y += ch+p), c = c->next; c; c = c->next) {
-        if (ISFFT(c)) continue;
-        if (b) { XMoveResizeWindow(dis, c->win, x, y, ch, cw); x += z; }
-        else   { XMoveResizeWindow(dis, c->win, x, y, cw, ch); y += z; }
+    if (!n) { r[0] = RECT(x, y, w - 2*bw, h - 2*bw); return; }
+    if (n > 1) { p = (z - sasz)%n + sasz; z = (z - sasz)/n; }
+
+    /* the first non-floating, non-fullscreen window covers the master area */
+    if (b) r[0] = RECT(x, y, w - 2*bw, ma - bw);
+    else   r[0] = RECT(x, y, ma - bw, h - 2*bw);
+
+    /* the next non-floating, non-fullscreen (and first) stack window gets p added */
+    int cw = (b ? h:w) - 2*bw - ma, ch = z - bw;
+    if (b) r[1] = RECT(x, y += ma, ch - bw + p, cw);
+    else   r[1] = RECT(x += ma, y, cw, ch - bw + p);
+
+    /* the rest of the non-floating, non-fullscreen stack windows
+     * with more stack windows than pixels ch+p can be negative, stay in the area */
+    if (b) x += MAX(ch+p, 0); else y += MAX(ch+p, 0);
+    for (int i = 2; i <= n; i++) {
+        if (b) { r[i] = RECT(x, y, ch, cw); x += z; }
+        else   { r[i] = RECT(x, y, cw, ch); y += z; }
     }
 }
 
+/**
+ * order clients from the bottom of the stack to the top, for qsort
+ * the clients whose position is not known go to the bottom
+ */
+int stackorder(const void *a, const void *b) {
+    int p = (*(Client *const *)a)->stackpos, q = (*(Client *const *)b)->stackpos;
+    return !p || !q ? !q - !p:q - p;
+}
+
+/**
+ * hash a string into one of 256 slots, FNV-1a
+ */
+unsigned int strhash(const char *s) {
+    unsigned int h = 2166136261U;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619U;
+    return (h ^ h >> 8 ^ h >> 16 ^ h >> 24) & 0xff;
+}
+
 /**
  * swap master window with current.
  * if current is head swap with next
  * if current is not head, then head
- * is behind us, so move_up until we
- * are the head
+ * is behind us, so move it to be the
+ * head, the ones before it moving down
+ *
+ * that keeps the order of the old linked list, a rotation of the clients
+ * up to the current one, so it costs a memmove and renumbering of their
+ * positions (see attach and detach), linear in the position of the
+ * current client, and a single relayout
  */
 void swap_master(void) {
     Desktop *d = &desktops[currdeskidx];
-    if (!d->curr || !d->head->next) return;
-    if (d->curr == d->head) move_down();
-    else while (d->curr != d->head) move_up();
-    focus(d->head, d);
+    if (!d->curr || d->count < 2) return;
+    if (d->curr == d->list[0]) move_down();
+    else {
+        Client *c = d->curr;
+        detach(c, d);
+        attach(c, d, 0);
+        if (!c->isfloat && !c->istrans) tile(d);
+    }
+    focus(d->list[0], d);
 }
 
 /**
@@ -1165,21 +3022,36 @@ void swap_master(void) {
  * if mode is FLOAT set all clients floating
  */
 void switch_mode(const Arg *arg) {
+    if (arg->i < 0 || arg->i >= MODES) return;
     Desktop *d = &desktops[currdeskidx];
     if (d->mode != arg->i) d->mode = arg->i;
-    else if (d->mode != FLOAT) for (Client *c = d->head; c; c = c->next) c->isfloat = False;
-    if (d->head) { tile(d); focus(d->curr, d); }
-    desktopinfo();
+    else if (d->mode != FLOAT) for (int i = 0; i < d->count; i++) d->list[i]->isfloat = False;
+    tile(d);
+    if (d->count) focus(d->curr, d);
 }
 
 /**
- * tile clients of the given desktop with the desktop's mode/layout
- * call the tiling handler fucntion taking account the panel height
+ * record that the requests made from now on are made on the given
+ * window, or on no client window at all if it is None.
+ *
+ * requests are sent without waiting for the server to reply, so
+ * errors arrive later and carry only the serial of the request that
+ * caused them, by which xerror finds the window the request was made on.
+ */
+void tagwindow(Window w) {
+    if (ntags && tags[(ntags - 1) % LENGTH(tags)].win == w) return;
+    tags[ntags % LENGTH(tags)].serial = NextRequest(dis);
+    tags[ntags++ % LENGTH(tags)].win = w;
+}
+
+/**
+ * move the layout generation of the given desktop, marking that
+ * something its layout depends on changed. the desktop is tiled
+ * (see arrange) when it is shown and the batch of events that
+ * changed it has been handled (see commit)
  */
 void tile(Desktop *d) {
-    if (!d->head || d->mode == FLOAT) return; /* nothing to arange */
-    layout[d->head->next ? d->mode:MONOCLE](0, TOP_PANEL && d->sbar ? PANEL_HEIGHT:0,
-                                                  ww, wh + (d->sbar ? 0:PANEL_HEIGHT), d);
+    d->gen++;
 }
 
 /**
@@ -1193,26 +3065,166 @@ void togglepanel(void) {
 /**
  * windows that request to unmap should lose their client
  * so invisible windows do not exist on screen
+ *
+ * a withdrawn window is no longer on any desktop, it is put back
+ * on the root. the unmaps the wm causes by reparenting are skipped
  */
 void unmapnotify(XEvent *e) {
     Desktop *d = NULL; Client *c = NULL;
-    if (wintoclient(e->xunmap.window, &c, &d)) removeclient(c, d);
+    if (!wintoclient(e->xunmap.window, &c, &d)) return;
+    if (c->unmaps && !e->xunmap.send_event) { c->unmaps--; return; }
+    tagwindow(c->win);
+    XDeleteProperty(dis, c->win, netatoms[NET_WM_DESKTOP]);
+    if (e->xunmap.send_event) XUnmapWindow(dis, c->win); /* only a notice, the window may still be mapped */
+    XReparentWindow(dis, c->win, root, c->x, c->y);
+    XRemoveFromSaveSet(dis, c->win);
+    removeclient(c, d);
+}
+
+/**
+ * publish on the root window what changed in the batch for pagers and panels
+ *
+ * the current desktop when it changed. the client list, in the order the
+ * windows were managed, when clients were removed, as new ones are appended
+ * as they come (see manage). the stacking list, from bottom to top, when
+ * windows were removed or restacked, or added other than on top of the
+ * current desktop, as those are appended as they come too, with the windows
+ * of the current desktop last and those of the others below in the order
+ * of the desktops.
+ *
+ * the stacking order of each desktop is kept from when it was last worked
+ * out (see refocus), and sorted again only when it is no longer known, so
+ * switching desktops only joins the orders of the desktops with clients.
+ */
+void updateewmh(void) {
+    if (ewmh.desk != currdeskidx) {
+        XChangeProperty(dis, root, netatoms[NET_CURRENT_DESKTOP], XA_CARDINAL, 32,
+                        PropModeReplace, (unsigned char *)&(long){(ewmh.desk = currdeskidx)}, 1);
+        ewmh.restacked = True;
+    }
+    if (ewmh.removed) XChangeProperty(dis, root, netatoms[NET_CLIENT_LIST], XA_WINDOW, 32,
+                                      PropModeReplace, (unsigned char *)ewmh.list, ewmh.count);
+    if (ewmh.restacked) {
+        int n = 0;
+        for (int i = 0; i <= nfilled; i++) {
+            Desktop *d = &desktops[i < nfilled ? filled[i]:currdeskidx];
+            if ((i < nfilled && filled[i] == currdeskidx) || !d->count) continue;
+            if (!d->sorted) {
+                Client *s[d->count];
+                memcpy(s, d->list, sizeof s);
+                qsort(s, d->count, sizeof *s, stackorder);
+                for (int k = 0; k < d->count; k++) d->stack[k] = s[k]->win;
+                d->sorted = True;
+            }
+            memcpy(ewmh.stack + n, d->stack, d->count * sizeof(Window));
+            n += d->count;
+        }
+        XChangeProperty(dis, root, netatoms[NET_CLIENT_STACKING], XA_WINDOW, 32,
+                        PropModeReplace, (unsigned char *)ewmh.stack, n);
+    }
+    ewmh.removed = ewmh.restacked = False;
+}
+
+/**
+ * read the monitors of the screen, from RandR when built with it,
+ * otherwise the whole screen of the given size is one monitor.
+ * there are never more monitors than desktops.
+ *
+ * monitors that are kept keep showing their desktop, which is tiled
+ * again only if the monitor changed. added monitors show the first
+ * hidden desktops. the desktops of removed monitors are hidden, and
+ * if the current desktop was one of them the first monitor gets the focus.
+ */
+void updategeometry(int w, int h) {
+    XRectangle r[ndesktops];
+    int n = 0;
+#ifdef RANDR
+    XRRMonitorInfo *mi = rrevbase < 0 ? NULL:XRRGetMonitors(dis, root, True, &n);
+    if (n > ndesktops) n = ndesktops;
+    for (int i = 0; i < n; i++) r[i] = (XRectangle){ mi[i].x, mi[i].y, mi[i].width, mi[i].height };
+    if (mi) XRRFreeMonitors(mi);
+#endif
+    if (n <= 0) r[(n = 1) - 1] = (XRectangle){ 0, 0, w, h };
+
+    for (int i = n; i < nmonitors; i++) showdesktop(&monitors[i], -1);
+    if (!(monitors = realloc(monitors, n * sizeof(Monitor)))) err(EXIT_FAILURE, "cannot allocate monitors");
+    for (int i = nmonitors; i < n; i++) monitors[i] = (Monitor){ .desk = -1 };
+    nmonitors = n;
+
+    for (int i = 0, k = 0; i < n; i++) {
+        Monitor *m = &monitors[i];
+        if (m->x == r[i].x && m->y == r[i].y && m->w == r[i].width && m->h == r[i].height - PANEL_HEIGHT && m->desk >= 0) continue;
+        *m = (Monitor){ r[i].x, r[i].y, r[i].width, r[i].height - PANEL_HEIGHT, m->desk };
+        if (m->desk < 0) { while (deskmon(k)) k++; showdesktop(m, k); }
+        else fitcontainer(&desktops[m->desk], m);
+        tile(&desktops[m->desk]);
+    }
+    if (!deskmon(currdeskidx)) desktops[(currdeskidx = monitors[0].desk)].dirty = True;
 }
 
 /**
  * find to which client and desktop the given window belongs to
+ *
+ * every managed window is kept in a hash table (wintable) chained
+ * through the clients' hnext references, so the lookup only walks
+ * the few clients that share the window's bucket instead of every
+ * client on every desktop.
  */
 Bool wintoclient(Window w, Client **c, Desktop **d) {
-    for (int i = 0; i < DESKTOPS && !*c; i++)
-        for (*d = &desktops[i], *c = (*d)->head; *c && (*c)->win != w; *c = (*c)->next);
+    for (*c = wintable[WINSLOT(w)]; *c && (*c)->win != w; *c = (*c)->hnext);
+    if (*c) *d = &desktops[(*c)->desk];
     return (*c != NULL);
 }
 
+/**
+ * whether the given window accepts WM_DELETE_WINDOW messages
+ */
+Bool wmdelete(Window w) {
+    Atom *prot = NULL; int n = -1;
+    if (XGetWMProtocols(dis, w, &prot, &n)) while (--n >= 0 && prot[n] != wmatoms[WM_DELETE_WINDOW]);
+    if (prot) XFree(prot);
+    return n >= 0;
+}
+
+#ifdef INOTIFY
+/**
+ * watch the config file itself, so writing the other files of its
+ * directory, $HOME by default, does not wake the wm.
+ * a file that is replaced or removed takes its watch with it, so then
+ * the directory is watched instead, until the file is there again
+ *
+ * return whether the file is watched
+ */
+Bool watchconfig(void) {
+    char dir[sizeof confpath];
+    if (watched >= 0) inotify_rm_watch(watch, watched);
+    if ((watched = inotify_add_watch(watch, confpath, IN_CLOSE_WRITE|IN_MOVE_SELF|IN_DELETE_SELF|IN_ATTRIB)) >= 0) return True;
+    snprintf(dir, sizeof dir, "%.*s", (int)(strrchr(confpath, '/') - confpath), confpath);
+    if ((watched = inotify_add_watch(watch, dir, IN_CLOSE_WRITE|IN_MOVED_TO)) < 0) warn("cannot watch %s", dir);
+    return False;
+}
+#endif
+
 /**
  * There's no way to check accesses to destroyed windows,
  * thus those cases are ignored (especially on UnmapNotify's).
+ *
+ * the failed request is matched by its serial to the window it was
+ * made on (see tagwindow). a request made on a client's window may
+ * fail as the window can be destroyed or unmapped at any time, so
+ * such errors are expected and ignored. other bad window errors are
+ * still ignored, but are reported by the debug build.
  */
 int xerror(__attribute__((unused)) Display *dis, XErrorEvent *ee) {
+    unsigned int t = LENGTH(tags);
+    for (unsigned int i = 0; i < LENGTH(tags) && i < ntags; i++) if (tags[i].serial <= ee->serial
+        && (t == LENGTH(tags) || tags[i].serial > tags[t].serial)) t = i;
+    if (t < LENGTH(tags) && tags[t].win != None && (ee->error_code == BadWindow
+        || ee->error_code == BadMatch || ee->error_code == BadDrawable)) return 0;
+#ifdef DEBUG
+    if (ee->error_code == BadWindow) warnx("xerror: request: %d on unknown window 0x%lx serial: %lu",
+                                           ee->request_code, ee->resourceid, ee->serial);
+#endif
     if ((ee->error_code == BadAccess   && (ee->request_code == X_GrabKey
                                        ||  ee->request_code == X_GrabButton))
     || (ee->error_code  == BadMatch    && (ee->request_code == X_SetInputFocus
@@ -1232,13 +3244,55 @@ int xerrorstart(__attribute__((unused)) Display *dis, __attribute__((unused)) XE
     errx(EXIT_FAILURE, "xerror: another window manager is already running");
 }
 
+#if defined ROUNDTRIPS || defined METRICS
+/**
+ * called by xlib after every request (see XSetAfterFunction)
+ *
+ * a request that waited for its reply leaves the last request
+ * known to be processed by the server equal to the last request
+ * sent, which otherwise lags behind as requests are not waited on.
+ */
+int countroundtrip(Display *dis) {
+    unsigned long r = LastKnownRequestProcessed(dis);
+    if (r == NextRequest(dis) - 1 && r != lastreply) { lastreply = r; roundtrips++; }
+    return 0;
+}
+#endif
+
+#ifdef BENCH
+/**
+ * a batch of events or commands starts being handled
+ */
+void benchstart(void) {
+    gettimeofday(&bench.start, NULL);
+    bench.req = NextRequest(dis);
+    bench.op = NULL;
+    bench.echo = False;
+}
+
+/**
+ * a batch was handled and its changes committed, report on stderr
+ * one tab separated line: the batch's name, which is the name of
+ * its first key binding or command, or else of its first event,
+ * skipping those that echo the wm's own changes to the geometry
+ * of windows and to the root's properties unless there are only
+ * those, then the microseconds it took and the requests it made
+ */
+void benchend(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (bench.op) fprintf(stderr, "bench\t%s\t%ld\t%lu\n", bench.op, (now.tv_sec - bench.start.tv_sec) * 1000000L
+                          + now.tv_usec - bench.start.tv_usec, NextRequest(dis) - bench.req);
+    bench.op = NULL;
+}
+#endif
+
 int main(int argc, char *argv[]) {
     if (argc == 2 && !strncmp(argv[1], "-v", 3))
         errx(EXIT_SUCCESS, "version: %s - by c00kiemon5ter >:3 omnomnomnom", VERSION);
     else if (argc != 1) errx(EXIT_FAILURE, "usage: man monsterwm");
     if (!(dis = XOpenDisplay(NULL))) errx(EXIT_FAILURE, "cannot open display");
     setup();
-    desktopinfo(); /* zero out every desktop on (re)start */
     run();
     cleanup();
     XCloseDisplay(dis);
@@ -0,0 +1,79 @@
+/* see license for copyright and license */
+
+/**
+ * golden test of the layouts (see layout)
+ *
+ * each layout is worked out for a range of window counts, areas, master
+ * and stack sizes and border widths, one line per case, and the lines
+ * are compared with the given file of the layouts known to be right.
+ * without a file the lines are written out, to make such a file with.
+ * every rectangle must also be in the area and not be empty, which is
+ * also checked for every window count up to MAXWINDOWS on a small area.
+ *
+ *   $ make test
+ *   $ test/layouts > test/layouts.golden
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+
+#define MAXWINDOWS 10000
+
+static const char *modenames[MODES] = { [TILE] = "tile", [MONOCLE] = "monocle", [BSTACK] = "bstack", [GRID] = "grid" };
+static const int counts[] = { 1, 2, 3, 4, 5, 6, 7, 9, 10, 16 };
+static const XRectangle areas[] = { { 0, 18, 1920, 1062 }, { 1366, 0, 1024, 768 } };
+static const struct { float mastersize; int masz, sasz, bw; } sizes[] = { { 0.52, 0, 0, 2 }, { 0.6, 13, 7, 0 }, { 0.5, -40, 25, 3 } };
+
+/**
+ * the first of the n rectangles that is empty or not in the area, or n
+ */
+unsigned int inside(const XRectangle *r, int n, const XRectangle *a) {
+    int i = 0;
+    while (i < n && r[i].width && r[i].height && r[i].x >= a->x && r[i].y >= a->y
+           && r[i].x + r[i].width <= a->x + a->width && r[i].y + r[i].height <= a->y + a->height) i++;
+    return i;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *f = NULL;
+    char line[BUFSIZ * 4], want[sizeof line];
+    int cases = 0, lineno = 0;
+    static XRectangle r[MAXWINDOWS];
+
+    if (argc > 2) errx(EXIT_FAILURE, "usage: layouts [golden file]");
+    if (argc == 2 && !(f = fopen(argv[1], "r"))) err(EXIT_FAILURE, "cannot open %s", argv[1]);
+
+    for (int m = 0; m < MODES; m++) if (layout[m])
+    for (unsigned int a = 0; a < LENGTH(areas); a++)
+    for (unsigned int s = 0; s < LENGTH(sizes); s++)
+    for (unsigned int k = 0; k < LENGTH(counts); k++) {
+        const XRectangle *ar = &areas[a];
+        int n = counts[k], masz = (m == BSTACK ? ar->height:ar->width) * sizes[s].mastersize + sizes[s].masz, len = 0;
+        layout[m](m, n, masz, sizes[s].sasz, *ar, sizes[s].bw, r);
+
+        len = snprintf(line, sizeof line, "%s n=%d masz=%d sasz=%d area=%d,%d,%dx%d bw=%d:", modenames[m], n, masz,
+                       sizes[s].sasz, ar->x, ar->y, ar->width, ar->height, sizes[s].bw);
+        for (int i = 0; i < n; i++)
+            len += snprintf(line + len, sizeof line - len, " %d,%d,%dx%d", r[i].x, r[i].y, r[i].width, r[i].height);
+        unsigned int i = inside(r, n, ar);
+        if (i < (unsigned int)n) errx(EXIT_FAILURE, "%s: window %u is empty or out of the area", line, i);
+        cases++;
+        if (!f) { puts(line); continue; }
+
+        lineno++;
+        if (!fgets(want, sizeof want, f)) errx(EXIT_FAILURE, "%s:%d: missing, expected\n%s", argv[1], lineno, line);
+        want[strcspn(want, "\n")] = '\0';
+        if (strcmp(want, line)) errx(EXIT_FAILURE, "%s:%d: differs\nwant: %s\ngot:  %s", argv[1], lineno, want, line);
+    }
+    if (f && fgets(want, sizeof want, f)) errx(EXIT_FAILURE, "%s:%d: more layouts than worked out", argv[1], lineno + 1);
+
+    const XRectangle small = { 0, 0, 800, 600 };
+    for (int m = 0; m < MODES; m++) if (layout[m]) for (int n = 1; n <= MAXWINDOWS; n++) {
+        layout[m](m, n, small.width * MASTER_SIZE, 0, small, BORDER_WIDTH, r);
+        unsigned int i = inside(r, n, &small);
+        if (i < (unsigned int)n) errx(EXIT_FAILURE, "%s n=%d: window %u is empty or out of the area", modenames[m], n, i);
+    }
+    if (f) printf("layouts: %d cases, same as %s, none empty or out of the area up to %d windows\n", cases, argv[1], MAXWINDOWS);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/* see license for copyright and license */
+
+/**
+ * differential test of the client lists (see attach and detach)
+ *
+ * random sequences of operations are replayed on a desktop and on a
+ * model of the singly linked client list monsterwm used to keep, with
+ * the list operations as they were written for it. after each operation
+ * the order of the clients and the current and previous clients must
+ * be the same.
+ *
+ *   $ make test
+ */
+
+#define main monsterwm
+#include "monsterwm.c"
+#undef main
+
+#define SEQUENCES 2000
+#define STEPS     400
+
+enum { OP_ADD, OP_REMOVE, OP_FOCUS, OP_NEXT, OP_PREV, OP_MOVEUP, OP_MOVEDOWN, OP_SWAP, OPS };
+static const char *opnames[OPS] = { "add", "remove", "focus", "next_win", "prev_win", "move_up", "move_down", "swap_master" };
+
+/**
+ * the old client list, a client is known by its window
+ * head - the first client, curr and prev as in Desktop
+ */
+typedef struct Old {
+    struct Old *next;
+    Window win;
+} Old;
+
+static struct { Old *head, *curr, *prev; } old;
+
+Old* oldprev(Old *c) {
+    Old *p = NULL;
+    if (c && old.head && old.head->next) for (p = old.head; p->next && p->next != c; p = p->next);
+    return p;
+}
+
+void oldfocus(Old *c) {
+    if (!old.head || !c) old.curr = old.prev = NULL;
+    else if (old.prev == c && old.curr != c->next) old.prev = oldprev((old.curr = c));
+    else if (old.curr != c) { old.prev = old.curr; old.curr = c; }
+}
+
+void oldadd(Window w) {
+    Old *c = calloc(1, sizeof(Old)), *t = oldprev(old.head);
+    if (!c) err(EXIT_FAILURE, "cannot allocate client");
+    c->win = w;
+    if (!old.head) old.head = c;
+    else if (!ATTACH_ASIDE) { c->next = old.head; old.head = c; }
+    else if (t) t->next = c; else old.head->next = c;
+    oldfocus(c);
+}
+
+void oldremove(Old *c) {
+    Old **p = NULL;
+    for (p = &old.head; *p && (*p != c); p = &(*p)->next);
+    if (!*p) return; else *p = c->next;
+    if (c == old.prev && !(old.prev = oldprev(old.curr))) old.prev = old.head;
+    if (c == old.curr || (old.head && !old.head->next)) oldfocus(old.prev);
+    free(c);
+}
+
+void oldmovedown(void) {
+    if (!old.curr || !old.head->next) return;
+    Old *p = oldprev(old.curr), *n = (old.curr->next) ? old.curr->next:old.head;
+    if (old.curr == old.head) old.head = n; else p->next = old.curr->next;
+    old.curr->next = (old.curr->next) ? n->next:n;
+    if (old.curr->next == n->next) n->next = old.curr; else old.head = old.curr;
+}
+
+void oldmoveup(void) {
+    if (!old.curr || !old.head->next) return;
+    Old *pp = NULL, *p = oldprev(old.curr);
+    if (p->next) for (pp = old.head; pp && pp->next != p; pp = pp->next);
+    if (pp) pp->next = old.curr; else old.head = (old.curr == old.head) ? old.curr->next:old.curr;
+    p->next = (old.curr->next == old.head) ? old.curr:old.curr->next;
+    old.curr->next = (old.curr->next == old.head) ? NULL:p;
+}
+
+void oldswap(void) {
+    if (!old.curr || !old.head->next) return;
+    if (old.curr == old.head) oldmovedown();
+    else while (old.curr != old.head) oldmoveup();
+    oldfocus(old.head);
+}
+
+/**
+ * compare the desktop with the model, print both on a difference
+ */
+Bool same(const Desktop *d) {
+    int i = 0;
+    Old *o = old.head;
+    for (; o && i < d->count && o->win == d->list[i]->win && d->list[i]->pos == i; o = o->next, i++);
+    if (!o && i == d->count && (old.curr ? old.curr->win:0) == (d->curr ? d->curr->win:0)
+        && (old.prev ? old.prev->win:0) == (d->prev ? d->prev->win:0)) return True;
+    fprintf(stderr, "old:");
+    for (o = old.head; o; o = o->next) fprintf(stderr, " %lu%s", o->win, o == old.curr ? "*":o == old.prev ? "^":"");
+    fprintf(stderr, "\nnew:");
+    for (i = 0; i < d->count; i++) fprintf(stderr, " %lu%s", d->list[i]->win, d->list[i] == d->curr ? "*":d->list[i] == d->prev ? "^":"");
+    fprintf(stderr, "\n");
+    return False;
+}
+
+int main(void) {
+    int ops[OPS] = {0};
+    Window next = 1;
+
+    ndesktops = 1;
+    if (!(desktops = calloc(1, sizeof(Desktop))) || !(filled = calloc(1, sizeof(int)))) err(EXIT_FAILURE, "cannot allocate desktop");
+    Desktop *d = &desktops[0];
+    srand(1);
+
+    for (int s = 0; s < SEQUENCES; s++) {
+        for (int k = 0; k < STEPS; k++) {
+            int op = rand() % OPS, n = d->count ? rand() % d->count:0;
+            if (op == OP_ADD || (op == OP_REMOVE && rand() % 2)) { /* keep the lists growing now and then */
+                Client *c = calloc(1, sizeof(Client));
+                if (!c) err(EXIT_FAILURE, "cannot allocate client");
+                c->win = next++;
+                attach(c, d, ATTACH_ASIDE ? d->count:0);
+                focus(c, d);
+                oldadd(c->win);
+                op = OP_ADD;
+            } else if (op == OP_REMOVE && d->count) {
+                Old *o = old.head;
+                while (o->win != d->list[n]->win) o = o->next;
+                removeclient(d->list[n], d);
+                oldremove(o);
+            } else if (op == OP_FOCUS && d->count) {
+                Old *o = old.head;
+                while (o->win != d->list[n]->win) o = o->next;
+                focus(d->list[n], d);
+                oldfocus(o);
+            } else if (op == OP_NEXT) {
+                next_win();
+                if (old.curr && old.head->next) oldfocus(old.curr->next ? old.curr->next:old.head);
+            } else if (op == OP_PREV) {
+                prev_win();
+                if (old.curr && old.head->next) oldfocus(oldprev(old.curr));
+            } else if (op == OP_MOVEUP) { move_up(); oldmoveup(); }
+            else if (op == OP_MOVEDOWN) { move_down(); oldmovedown(); }
+            else if (op == OP_SWAP) { swap_master(); oldswap(); }
+            ops[op]++;
+            if (!same(d)) errx(EXIT_FAILURE, "sequence %d, step %d: %s differs", s, k, opnames[op]);
+        }
+        while (d->count) { removeclient(d->list[0], d); oldremove(old.head); }
+        if (!same(d) || nfilled) errx(EXIT_FAILURE, "sequence %d: emptying differs", s);
+    }
+
+    printf("lists: %d sequences of %d steps, same as the old lists (", SEQUENCES, STEPS);
+    for (int i = 0; i < OPS; i++) printf("%s%s %d", i ? ", ":"", opnames[i], ops[i]);
+    printf(")\n");
+    return EXIT_SUCCESS;
+}